@@ -0,0 +1,161 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Fallback to the kernel's jitterentropy_rng via AF_ALG
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Linux offers its own CPU Jitter RNG, jitterentropy_rng, to user space
+ * through the "rng" type of AF_ALG sockets. The kernel reads a clock source
+ * that may be finer than the clocks available to user space, e.g. when a
+ * hypervisor traps clock_gettime.
+ *
+ * An entropy collector allocated with JENT_AFALG_FALLBACK on a host where
+ * jent_entropy_init failed is served by the kernel: jent_read_entropy
+ * reads from the AF_ALG operation socket instead of running the entropy
+ * collection. If jent_entropy_init succeeded, the flag has no effect. The
+ * kernel hands out at most 128 bytes per read; the read loops as needed.
+ */
+
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <linux/if_alg.h>
+
+#include "jitterentropy.h"
+
+#ifndef AF_ALG
+#define AF_ALG 38
+#endif
+
+struct jent_afalg {
+	int tfm_fd;	/* socket bound to the algorithm */
+	int op_fd;	/* operation socket the output is read from */
+};
+
+/*
+ * Open the kernel's jitterentropy_rng.
+ *
+ * return: handle or NULL with errno set if AF_ALG or the algorithm is not
+ *	   available
+ */
+struct jent_afalg *jent_afalg_open(void)
+{
+	struct sockaddr_alg sa = {
+		.salg_family = AF_ALG,
+		.salg_type = "rng",
+		.salg_name = "jitterentropy_rng",
+	};
+	struct jent_afalg *afalg;
+	int err;
+
+	afalg = jent_zalloc(sizeof(struct jent_afalg));
+	if (NULL == afalg)
+		return NULL;
+	afalg->op_fd = -1;
+	afalg->tfm_fd = socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (0 > afalg->tfm_fd)
+		goto err;
+	if (bind(afalg->tfm_fd, (struct sockaddr *)&sa, sizeof(sa)))
+		goto err;
+	afalg->op_fd = accept4(afalg->tfm_fd, NULL, 0, SOCK_CLOEXEC);
+	if (0 > afalg->op_fd)
+		goto err;
+
+	return afalg;
+
+err:
+	err = errno;
+	jent_afalg_close(afalg);
+	errno = err;
+	return NULL;
+}
+
+/*
+ * return: @len on success, < 0 on error
+ */
+int jent_afalg_read(struct jent_afalg *afalg, char *data, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t ret = read(afalg->op_fd, data + done, len - done);
+
+		if (0 > ret && EINTR == errno)
+			continue;
+		if (0 >= ret)
+			return -1;
+		done += ret;
+	}
+	return len;
+}
+
+void jent_afalg_close(struct jent_afalg *afalg)
+{
+	if (NULL == afalg)
+		return;
+	if (0 <= afalg->op_fd)
+		close(afalg->op_fd);
+	if (0 <= afalg->tfm_fd)
+		close(afalg->tfm_fd);
+	jent_zfree(afalg, sizeof(struct jent_afalg));
+}
+
+/*
+ * Allocate an entropy collector served by the kernel. It carries no state
+ * of its own besides the AF_ALG sockets.
+ */
+struct rand_data *jent_afalg_collector_alloc(unsigned int osr,
+					     unsigned int flags)
+{
+	struct rand_data *entropy_collector;
+
+	entropy_collector = jent_zalloc(sizeof(struct rand_data));
+	if (NULL == entropy_collector)
+		return NULL;
+	entropy_collector->afalg = jent_afalg_open();
+	if (NULL == entropy_collector->afalg) {
+		jent_zfree(entropy_collector, sizeof(struct rand_data));
+		return NULL;
+	}
+	entropy_collector->osr = osr ? osr : 1;
+	entropy_collector->flags = flags;
+	return entropy_collector;
+}
+
+void jent_afalg_collector_free(struct rand_data *entropy_collector)
+{
+	jent_afalg_close(entropy_collector->afalg);
+	jent_zfree(entropy_collector, sizeof(struct rand_data));
+}
@@ -0,0 +1,579 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * SP 800-90B min-entropy assessment of raw time deltas
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * jent-assess runs the SP 800-90B non-IID estimators on the raw time deltas
+ * of the CPU Jitter RNG. The deltas are either read from a capture file or
+ * captured live. Capture files are either in the format described in
+ * jitterentropy-capture.h, whose chunks are decoded in parallel, or hold
+ * native 64 bit words as written by jent_read_raw.
+ *
+ * Each delta is reduced to a symbol of its low bits. The symbols are kept
+ * in one byte each and the bit string for the binary estimators in one
+ * byte per bit, both shared read-only by all threads. The estimators run
+ * in parallel, one estimator per thread at a time. The lag prediction, the
+ * longest running estimator, is in addition split into one range of
+ * samples per thread; its second pass runs once all other estimators are
+ * done. The remaining estimators are single threaded: the t-tuple and LRS
+ * estimates rest on one suffix array of all samples and the predictors
+ * depend on the outcome of all earlier predictions.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <math.h>
+
+#include "jitterentropy.h"
+#include "jitterentropy-estimate.h"
+#include "jitterentropy-capture.h"
+
+static unsigned int Bits = 8;
+static unsigned int Threads = 0;
+static size_t Max_samples = 0;
+static size_t Live_samples = 0;
+static char *Outfile = NULL;
+
+/* symbols, bit string and number of distinct symbols */
+static __u8 *Sym = NULL;
+static __u8 *Bitstring = NULL;
+static size_t Nr_sym = 0;
+static unsigned int Nr_distinct = 0;
+
+enum jent_assess_est {
+	EST_MCV,
+	EST_COLLISION,
+	EST_MARKOV,
+	EST_COMPRESSION,
+	EST_T_TUPLE,
+	EST_LRS,
+	EST_MULTI_MCW,
+	EST_LAG,
+	EST_MAX
+};
+
+static const char *Est_name[EST_MAX] = {
+	"Most common value",
+	"Collision",
+	"Markov",
+	"Compression",
+	"t-Tuple",
+	"LRS",
+	"MultiMCW prediction",
+	"Lag prediction",
+};
+
+/* results per symbol, estimators on the bit string are scaled */
+static double Result[EST_MAX];
+
+static void est_mcv(void)
+{
+	Result[EST_MCV] = jent_est_mcv_sym(Sym, Nr_sym);
+}
+
+static void est_collision(void)
+{
+	Result[EST_COLLISION] = Bits *
+		jent_est_collision(Bitstring, Nr_sym * Bits);
+}
+
+static void est_markov(void)
+{
+	Result[EST_MARKOV] = Bits * jent_est_markov(Bitstring, Nr_sym * Bits);
+}
+
+static void est_compression(void)
+{
+	Result[EST_COMPRESSION] = Bits *
+		jent_est_compression(Bitstring, Nr_sym * Bits);
+}
+
+static void est_tuple(void)
+{
+	if (jent_est_tuple(Sym, Nr_sym, &Result[EST_T_TUPLE],
+			   &Result[EST_LRS])) {
+		Result[EST_T_TUPLE] = -1;
+		Result[EST_LRS] = -1;
+	}
+}
+
+static void est_multi_mcw(void)
+{
+	Result[EST_MULTI_MCW] = jent_est_multi_mcw(Sym, Nr_sym, Nr_distinct);
+}
+
+/* tasks ordered by their runtime, the longest first */
+static void (*Task[])(void) = {
+	est_compression,
+	est_tuple,
+	est_multi_mcw,
+	est_collision,
+	est_markov,
+	est_mcv,
+};
+#define NR_TASKS (sizeof(Task) / sizeof(Task[0]))
+
+/* ranges of the lag prediction, each at least LAG_MIN_SAMPLES long */
+#define LAG_MIN_SAMPLES 65536
+static struct jent_est_lag_part *Lag_part = NULL;
+static unsigned int Nr_lag_parts = 0;
+
+static pthread_mutex_t Task_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int Task_next = 0;
+
+/* estimators followed by the first pass of the lag prediction ranges */
+static void *task_worker(void *arg)
+{
+	while (1) {
+		unsigned int task;
+
+		pthread_mutex_lock(&Task_lock);
+		task = Task_next++;
+		pthread_mutex_unlock(&Task_lock);
+		if (task < NR_TASKS)
+			Task[task]();
+		else if (task - NR_TASKS < Nr_lag_parts)
+			jent_est_lag_count(Sym, &Lag_part[task - NR_TASKS]);
+		else
+			break;
+	}
+
+	return NULL;
+}
+
+/* second pass of the lag prediction ranges */
+static void *lag_worker(void *arg)
+{
+	while (1) {
+		unsigned int part;
+
+		pthread_mutex_lock(&Task_lock);
+		part = Task_next++;
+		pthread_mutex_unlock(&Task_lock);
+		if (part >= Nr_lag_parts)
+			break;
+		jent_est_lag_predict(Sym, Lag_part, part);
+	}
+
+	return NULL;
+}
+
+static unsigned int nr_threads(void)
+{
+	long cpus;
+
+	if (Threads)
+		return Threads;
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cpus > 0) ? cpus : 1;
+}
+
+/* run @worker on up to @max threads */
+static int run_threads(void *(*worker)(void *), unsigned int max)
+{
+	pthread_t *thread = NULL;
+	unsigned int i, nr = nr_threads(), started = 0;
+
+	if (nr > max)
+		nr = max;
+
+	thread = calloc(nr, sizeof(pthread_t));
+	if (NULL == thread)
+		return -ENOMEM;
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&thread[i], NULL, worker, NULL))
+			break;
+		started++;
+	}
+	/* without any thread, the calling thread does all the work */
+	if (!started)
+		worker(NULL);
+	for (i = 0; i < started; i++)
+		pthread_join(thread[i], NULL);
+	free(thread);
+
+	return 0;
+}
+
+/* store deltas as symbols starting at sample @pos */
+static void store_samples(const __u64 *delta, size_t n, size_t pos)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++, pos++) {
+		__u8 s = delta[i] & ((1U << Bits) - 1);
+		unsigned int j;
+
+		Sym[pos] = s;
+		for (j = 0; j < Bits; j++)
+			Bitstring[pos * Bits + j] = (s >> (Bits - 1 - j)) & 1;
+	}
+}
+
+static void add_samples(const __u64 *delta, size_t n)
+{
+	store_samples(delta, n, Nr_sym);
+	Nr_sym += n;
+}
+
+static int alloc_samples(size_t n)
+{
+	Sym = malloc(n);
+	Bitstring = malloc(n * Bits);
+	if (NULL == Sym || NULL == Bitstring)
+		return -ENOMEM;
+	return 0;
+}
+
+#define CHUNK_WORDS 65536
+
+/* parallel decoding of the chunks of a capture */
+static struct jent_capture *Capture = NULL;
+static __u64 Chunk_next = 0;
+static __u64 Nr_chunks = 0;
+static int Chunk_err = 0;
+
+static void *chunk_worker(void *arg)
+{
+	const struct jent_capture_meta *meta = jent_capture_get_meta(Capture);
+	__u64 *buf = malloc(meta->chunk_samples * sizeof(__u64));
+
+	while (NULL != buf) {
+		__u64 chunk;
+		size_t pos;
+		int ret;
+
+		pthread_mutex_lock(&Task_lock);
+		chunk = Chunk_next++;
+		pthread_mutex_unlock(&Task_lock);
+		if (chunk >= Nr_chunks)
+			break;
+
+		ret = jent_capture_read_chunk(Capture, chunk, buf);
+		/* all chunks but the last one are full */
+		pos = chunk * meta->chunk_samples;
+		if (0 > ret) {
+			Chunk_err = ret;
+			break;
+		}
+		if (pos + ret > Nr_sym)
+			ret = Nr_sym - pos;
+		store_samples(buf, ret, pos);
+	}
+	if (NULL == buf)
+		Chunk_err = -ENOMEM;
+	free(buf);
+
+	return NULL;
+}
+
+static int read_indexed_capture(void)
+{
+	const struct jent_capture_meta *meta = jent_capture_get_meta(Capture);
+	int ret;
+
+	Nr_sym = meta->nr_samples;
+	if (Max_samples && Max_samples < Nr_sym)
+		Nr_sym = Max_samples;
+	Nr_chunks = (Nr_sym + meta->chunk_samples - 1) / meta->chunk_samples;
+	if (alloc_samples(Nr_sym ? Nr_sym : 1))
+		return -ENOMEM;
+
+	fprintf(stderr, "Capture of host %s, CPU %s, timer %s, osr %u, flags 0x%x\n",
+		meta->host, meta->cpu, meta->timer, meta->osr, meta->flags);
+
+	ret = run_threads(chunk_worker, Nr_chunks ? Nr_chunks : 1);
+	if (!ret)
+		ret = Chunk_err;
+	if (ret)
+		fprintf(stderr, "Cannot decode capture: %s\n", strerror(-ret));
+	return ret;
+}
+
+static int read_capture(const char *name)
+{
+	FILE *f = stdin;
+	__u64 *buf = NULL;
+	size_t cap = CHUNK_WORDS;
+	int ret = 0;
+
+	if (strcmp(name, "-")) {
+		Capture = jent_capture_open(name);
+		if (NULL != Capture) {
+			ret = read_indexed_capture();
+			jent_capture_close(Capture);
+			return ret;
+		}
+		if (EINVAL != errno) {
+			fprintf(stderr, "Cannot open %s: %s\n", name,
+				strerror(errno));
+			return -errno;
+		}
+
+		/* no indexed capture, read native 64 bit words */
+		f = fopen(name, "rb");
+		if (NULL == f) {
+			fprintf(stderr, "Cannot open %s: %s\n", name,
+				strerror(errno));
+			return -errno;
+		}
+	}
+
+	buf = malloc(CHUNK_WORDS * sizeof(__u64));
+	if (NULL == buf || alloc_samples(cap)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	while (!Max_samples || Nr_sym < Max_samples) {
+		size_t want = CHUNK_WORDS, got;
+
+		if (Max_samples && Max_samples - Nr_sym < want)
+			want = Max_samples - Nr_sym;
+		got = fread(buf, sizeof(__u64), want, f);
+		if (!got)
+			break;
+		if (Nr_sym + got > cap) {
+			cap *= 2;
+			Sym = realloc(Sym, cap);
+			Bitstring = realloc(Bitstring, cap * Bits);
+			if (NULL == Sym || NULL == Bitstring) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+		add_samples(buf, got);
+	}
+	if (ferror(f))
+		ret = -EIO;
+
+out:
+	free(buf);
+	if (stdin != f)
+		fclose(f);
+	return ret;
+}
+
+static int capture_live(void)
+{
+	struct rand_data *ec = NULL;
+	struct jent_capture *out = NULL;
+	__u64 *buf = NULL;
+	int ret = jent_entropy_init();
+
+	if (ret) {
+		fprintf(stderr, "The initialization of CPU Jitter RNG failed with error code %d\n", ret);
+		return -EFAULT;
+	}
+	ec = jent_entropy_collector_alloc(1, 0);
+	buf = malloc(CHUNK_WORDS * sizeof(__u64));
+	if (NULL == ec || NULL == buf || alloc_samples(Live_samples)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (Outfile) {
+		struct jent_capture_meta meta;
+
+		jent_capture_meta_init(&meta, 1, 0);
+		out = jent_capture_create(Outfile, &meta);
+		if (NULL == out) {
+			fprintf(stderr, "Cannot open %s: %s\n", Outfile,
+				strerror(errno));
+			ret = -errno;
+			goto out;
+		}
+	}
+
+	while (Nr_sym < Live_samples) {
+		size_t want = Live_samples - Nr_sym;
+
+		if (want > CHUNK_WORDS)
+			want = CHUNK_WORDS;
+		if (0 > jent_read_raw(ec, buf, want)) {
+			fprintf(stderr, "Repetition count test of the raw deltas failed\n");
+			ret = -EFAULT;
+			goto out;
+		}
+		if (out) {
+			ret = jent_capture_write(out, buf, want);
+			if (ret)
+				goto out;
+		}
+		add_samples(buf, want);
+	}
+
+out:
+	if (jent_capture_close(out) && !ret) {
+		fprintf(stderr, "Cannot complete capture %s\n", Outfile);
+		ret = -EIO;
+	}
+	free(buf);
+	jent_entropy_collector_free(ec);
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "\nSP 800-90B min-entropy assessment of the CPU Jitter RNG raw time deltas\n\n");
+	fprintf(stderr, "Usage: jent-assess [options] [capture file or - for stdin]\n");
+	fprintf(stderr, "\t-b\tNumber of low bits of each delta forming a symbol,\n");
+	fprintf(stderr, "\t\t1 to 8 (default 8)\n");
+	fprintf(stderr, "\t-t\tNumber of threads (default: number of CPUs)\n");
+	fprintf(stderr, "\t-n\tMaximum number of samples read from the capture\n");
+	fprintf(stderr, "\t-l\tCapture the given number of samples live instead\n");
+	fprintf(stderr, "\t\tof reading a capture file\n");
+	fprintf(stderr, "\t-w\tWrite the live capture to file in the indexed\n");
+	fprintf(stderr, "\t\tcapture format\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"bits", 1, 0, 'b'},
+			{"threads", 1, 0, 't'},
+			{"samples", 1, 0, 'n'},
+			{"live", 1, 0, 'l'},
+			{"write", 1, 0, 'w'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "b:t:n:l:w:", opts, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'b':
+			Bits = strtoul(optarg, NULL, 10);
+			if (!Bits || 8 < Bits)
+				usage();
+			break;
+		case 't':
+			Threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			Max_samples = strtoull(optarg, NULL, 10);
+			break;
+		case 'l':
+			Live_samples = strtoull(optarg, NULL, 10);
+			if (!Live_samples)
+				usage();
+			break;
+		case 'w':
+			Outfile = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((Live_samples && optind < argc) ||
+	    (!Live_samples && optind + 1 != argc))
+		usage();
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int seen[256] = { 0 };
+	double min = INFINITY;
+	size_t i;
+	int ret;
+
+	parse_opts(argc, argv);
+
+	if (Live_samples)
+		ret = capture_live();
+	else
+		ret = read_capture(argv[optind]);
+	if (ret)
+		return 1;
+	if (!Nr_sym) {
+		fprintf(stderr, "No samples\n");
+		return 1;
+	}
+
+	for (i = 0; i < Nr_sym; i++) {
+		if (!seen[Sym[i]]++)
+			Nr_distinct++;
+	}
+
+	Lag_part = calloc(nr_threads(), sizeof(*Lag_part));
+	if (NULL == Lag_part)
+		return 1;
+	Nr_lag_parts = jent_est_lag_split(Nr_sym, LAG_MIN_SAMPLES, Lag_part,
+					  nr_threads());
+	if (run_threads(task_worker, NR_TASKS + Nr_lag_parts))
+		return 1;
+	Task_next = 0;
+	if (Nr_lag_parts && run_threads(lag_worker, Nr_lag_parts))
+		return 1;
+	Result[EST_LAG] = jent_est_lag_finish(Lag_part, Nr_lag_parts, Nr_sym,
+					      Nr_distinct);
+	free(Lag_part);
+
+	printf("Samples:\t\t%zu\n", Nr_sym);
+	printf("Symbol width:\t\t%u bits, %u distinct symbols\n\n", Bits,
+	       Nr_distinct);
+	for (i = 0; i < EST_MAX; i++) {
+		if (0 > Result[i]) {
+			printf("%-24s(insufficient data)\n", Est_name[i]);
+		} else if (isinf(Result[i])) {
+			printf("%-24s(not applicable)\n", Est_name[i]);
+		} else {
+			printf("%-24s%f\n", Est_name[i], Result[i]);
+			if (Result[i] < min)
+				min = Result[i];
+		}
+	}
+	if (isinf(min)) {
+		printf("\nNo min-entropy estimate\n");
+		ret = 1;
+	} else {
+		printf("\nMin-entropy:\t\t%f bits per %u bit symbol\n", min,
+		       Bits);
+	}
+
+	free(Sym);
+	free(Bitstring);
+	return ret;
+}
@@ -65,6 +65,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+#include <limits.h>
 
 #ifdef LIBGCRYPT
 #include <config.h>
@@ -88,11 +90,19 @@
 
 /* typedef uint64_t __u64; */
 
+#ifdef JENT_MOCK_CLOCK
+/* Benchmark builds only: deterministic time stamps from
+ * jitterentropy-mock.c -- provides no entropy at all */
+void jent_mock_nstime(__u64 *out);
+#endif
+
 static inline void jent_get_nstime(__u64 *out)
 {
+#ifdef JENT_MOCK_CLOCK
+	jent_mock_nstime(out);
+#elif defined(__MACH__)
 	/* OSX does not have clock_gettime -- taken from
 	 * http://developer.apple.com/library/mac/qa/qa1398/_index.html */
-#ifdef __MACH__
 	*out = mach_absolute_time();
 #elif _AIX
 	/* clock_gettime() on AIX returns a timer value that increments in
@@ -62,6 +62,14 @@
  * Update of the loop count used for the next round of
  * an entropy collection.
  *
+ * When the entropy collector is allocated with JENT_SINGLE_TIMESTAMP, the
+ * timer is not read again. Instead, the time stamp that jent_measure_jitter
+ * just obtained and stored in ->prev_time is used. That time stamp is taken
+ * right before the folding operation, so the loop count still depends on
+ * the timing of the previous round. This saves one timer read per sample
+ * which is significant where reading the timer is expensive (e.g. virtual
+ * machines where clock_gettime traps into the hypervisor).
+ *
  * Input:
  * @ec entropy collector struct -- may be NULL
  * @bits is the number of low bits of the timer to consider
@@ -79,7 +87,10 @@ static __u64 jent_loop_shuffle(struct rand_data *ec,
 	int i = 0;
 	unsigned int mask = (1<<bits) - 1;
 
-	jent_get_nstime(&time);
+	if (ec && ec->single_timestamp)
+		time = ec->prev_time;
+	else
+		jent_get_nstime(&time);
 	/* mix the current state of the random number into the shuffle
 	 * calculation to balance that shuffle a bit more */
 	if (ec)
@@ -127,6 +138,11 @@ static __u64 jent_loop_shuffle(struct rand_data *ec,
  * is used to measure the CPU execution time jitter. Any change to the loop in
  * this function implies that careful retesting must be done.
  *
+ * If the entropy collector is allocated with JENT_FIXED_COST, the loop
+ * shuffle is not used and the folding is always performed
+ * FIXED_FOLD_LOOP_CNT (8) times -- just below the mean of 8.5 of the
+ * shuffled loop count, which ranges from 1 to 16.
+ *
  * Input:
  * @ec entropy collector struct -- may be NULL
  * @time time stamp to be folded
@@ -146,8 +162,12 @@ static __u64 jent_fold_time(struct rand_data *ec, __u64 time,
 	__u64 new = 0;
 #define MAX_FOLD_LOOP_BIT 4
 #define MIN_FOLD_LOOP_BIT 0
-	__u64 fold_loop_cnt =
-		jent_loop_shuffle(ec, MAX_FOLD_LOOP_BIT, MIN_FOLD_LOOP_BIT);
+#define FIXED_FOLD_LOOP_CNT (1<<(MAX_FOLD_LOOP_BIT - 1))
+	__u64 fold_loop_cnt = FIXED_FOLD_LOOP_CNT;
+
+	if (!ec || !ec->fixed_cost)
+		fold_loop_cnt = jent_loop_shuffle(ec, MAX_FOLD_LOOP_BIT,
+						  MIN_FOLD_LOOP_BIT);
 
 	/* testing purposes -- allow test app to set the counter, not
 	 * needed during runtime */
@@ -224,6 +244,34 @@ static unsigned int jent_memaccess(struct rand_data *ec)
  * Start of entropy processing logic
  ***************************************************************************/
 
+#ifdef JENT_INSTRUMENT
+/*
+ * Instrumentation probe of one time delta. The probe runs between two time
+ * stamps and thus adds to the next time delta -- use jent-bench-observe to
+ * verify that an instrumentation feature does not measurably change the
+ * distribution of the time deltas before enabling it. The probes are only
+ * compiled into builds with JENT_INSTRUMENT so that the regular entropy
+ * collection does not carry them.
+ */
+static void jent_instrument_delta(struct rand_data *ec, __u64 delta)
+{
+	if (ec->instrument & JENT_INSTR_COUNTERS) {
+		ec->instr_samples++;
+		ec->instr_delta_sum += delta;
+	}
+	if (ec->instrument & JENT_INSTR_HISTOGRAM) {
+		__u64 val = delta;
+		unsigned int bucket = 0;
+
+		while (val >>= 1)
+			bucket++;
+		ec->instr_hist[bucket]++;
+	}
+	if ((ec->instrument & JENT_INSTR_TRACE) && ec->instr_trace)
+		ec->instr_trace(ec->instr_priv, delta);
+}
+#endif
+
 /*
  * This is the heart of the entropy generation: calculate time deltas and
  * use the CPU jitter in the time deltas. The jitter is folded into one
@@ -237,11 +285,16 @@ static unsigned int jent_memaccess(struct rand_data *ec)
  * Input:
  * @entropy_collector Reference to entropy collector
  *
+ * Output:
+ * @ret_current_delta if not NULL, the time delta of this round is stored
+ *		       there before it is folded
+ *
  * Return:
  * One random bit
  *
  */
-static __u64 jent_measure_jitter(struct rand_data *entropy_collector)
+static __u64 jent_measure_jitter(struct rand_data *entropy_collector,
+				 __u64 *ret_current_delta)
 {
 	__u64 time = 0;
 	__u64 delta = 0;
@@ -255,6 +308,12 @@ static __u64 jent_measure_jitter(struct rand_data *entropy_collector)
 	jent_get_nstime(&time);
 	delta = time - entropy_collector->prev_time;
 	entropy_collector->prev_time = time;
+	if (ret_current_delta)
+		*ret_current_delta = delta;
+#ifdef JENT_INSTRUMENT
+	if (entropy_collector->instrument)
+		jent_instrument_delta(entropy_collector, delta);
+#endif
 
 	/* Now call the next noise sources which also folds the data */
 	jent_fold_time(entropy_collector, delta, &data, 0);
@@ -270,6 +329,14 @@ static __u64 jent_measure_jitter(struct rand_data *entropy_collector)
  * document "A proposal for: Functionality classes for random number
  * generators", version 2.0 by Werner Schindler, section 5.4.1.
  *
+ * The number of rejected pairs is geometrically distributed and thus not
+ * bounded. If ->unbias_budget is set (JENT_FIXED_COST), at most that many
+ * pairs are rejected for one 64 bit word. Once the budget is used up, the
+ * first bit of a rejected pair is returned as is and accounted for in
+ * ->unbias_fallbacks so that the caller can decide how to treat that word.
+ * ->unbias_pairs and ->unbias_discarded count all evaluated and rejected
+ * pairs over the lifetime of the entropy collector.
+ *
  * Input:
  * @entropy_collector Reference to entropy collector
  *
@@ -279,12 +346,22 @@ static __u64 jent_measure_jitter(struct rand_data *entropy_collector)
 static __u64 jent_unbiased_bit(struct rand_data *entropy_collector)
 {
 	if (1 == entropy_collector->disable_unbias)
-		return (jent_measure_jitter(entropy_collector));
+		return (jent_measure_jitter(entropy_collector, NULL));
 	do {
-		__u64 a = jent_measure_jitter(entropy_collector);
-		__u64 b = jent_measure_jitter(entropy_collector);
-		if (a == b)
+		__u64 a = jent_measure_jitter(entropy_collector, NULL);
+		__u64 b = jent_measure_jitter(entropy_collector, NULL);
+		entropy_collector->unbias_pairs++;
+		if (a == b) {
+			entropy_collector->unbias_discarded++;
+			if (entropy_collector->unbias_budget &&
+			    entropy_collector->unbias_rejects >=
+			    entropy_collector->unbias_budget) {
+				entropy_collector->unbias_fallbacks++;
+				return a;
+			}
+			entropy_collector->unbias_rejects++;
 			continue;
+		}
 		if (1 == a)
 			return 1;
 		else
@@ -363,6 +440,8 @@ static void jent_gen_entropy(struct rand_data *entropy_collector)
 {
 	unsigned int k;
 
+	entropy_collector->unbias_rejects = 0;
+
 	/* number of loops for the entropy collection depends on the size of
 	 * the random number and the size of the folded value. We want to
 	 * ensure that we pass over each bit of the random value once with the
@@ -382,7 +461,7 @@ static void jent_gen_entropy(struct rand_data *entropy_collector)
 		__u64 prev_data = entropy_collector->data;
 		/* priming of the ->prev_time value in first loop iteration */
 		if (!k)
-			jent_measure_jitter(entropy_collector);
+			jent_measure_jitter(entropy_collector, NULL);
 
 		data = jent_unbiased_bit(entropy_collector);
 		entropy_collector->data ^= data;
@@ -394,6 +473,10 @@ static void jent_gen_entropy(struct rand_data *entropy_collector)
 	}
 	if (entropy_collector->stir)
 		jent_stir_pool(entropy_collector);
+#ifdef JENT_INSTRUMENT
+	if (entropy_collector->instrument & JENT_INSTR_COUNTERS)
+		entropy_collector->instr_words++;
+#endif
 }
 
 /* the continuous test required by FIPS 140-2 -- the function automatically
@@ -449,6 +532,12 @@ static int jent_fips_test(struct rand_data *entropy_collector)
  * The following error codes can occur:
  * 	-1	FIPS 140-2 continuous self test failed
  * 	-2	entropy_collector is NULL
+ * 	-3	reading the kernel RNG of JENT_AFALG_FALLBACK failed
+ *
+ * With JENT_FIXED_COST, a word whose Von-Neuman rejection budget is used
+ * up still completes with bits taken without unbias, which happens when
+ * the noise source degrades. The read succeeds nonetheless -- callers that
+ * care compare jent_unbias_fallbacks before and after the read.
  */
 int jent_read_entropy(struct rand_data *entropy_collector,
 		      char *data, size_t len)
@@ -460,6 +549,14 @@ int jent_read_entropy(struct rand_data *entropy_collector,
 	if (NULL == entropy_collector)
 		return -2;
 
+#ifndef __KERNEL__
+	if (NULL != entropy_collector->afalg) {
+		if (0 > jent_afalg_read(entropy_collector->afalg, data, len))
+			return -3;
+		return orig_len;
+	}
+#endif
+
 	while (0 < len) {
 		size_t tocopy;
 		jent_gen_entropy(entropy_collector);
@@ -498,31 +595,312 @@ int jent_read_entropy(struct rand_data *entropy_collector,
 EXPORT_SYMBOL(jent_read_entropy);
 #endif
 
+/*
+ * Entry function: Obtain raw time deltas for the caller.
+ *
+ * WARNING: the returned values are NOT random numbers! They are the raw
+ * time deltas the noise sources produce before any folding, Von-Neuman
+ * unbias or stirring is applied. Each delta only contains a small amount
+ * of entropy -- the design of the RNG assumes not more than one bit per
+ * delta. The caller MUST process the data with an appropriate conditioning
+ * function, crediting at most one bit of entropy per delta, before using
+ * it for anything else. The deltas must be treated as sensitive data.
+ *
+ * Both noise sources are invoked exactly as for jent_read_entropy, i.e.
+ * each delta covers the memory access and the folding loop of the previous
+ * round.
+ *
+ * The deltas are subjected to a repetition count test: if the same delta
+ * is observed JENT_RAW_RCT_CUTOFF times in a row, the noise source is
+ * considered stuck and an error is returned. The test state is kept in
+ * the entropy collector, so repetitions spanning several calls are counted
+ * as well. With an entropy of one bit per delta, that cutoff implies a
+ * false positive rate of 2^-20. In FIPS mode, a failure is latched like a
+ * failure of the FIPS 140-2 continuous test and the entropy collector
+ * cannot be used any more.
+ *
+ * @deltas: pointer to buffer for storing the time deltas -- buffer must
+ *	    already exist
+ * @n: number of time deltas to be stored in the buffer
+ *
+ * return: number of deltas returned when request is fulfilled or an error
+ *
+ * The following error codes can occur:
+ *	-1	FIPS 140-2 continuous self test or repetition count test failed
+ *	-2	entropy_collector is NULL
+ *	-3	entropy_collector is served by the kernel (JENT_AFALG_FALLBACK)
+ *		and has no time deltas
+ *	-4	n is larger than INT_MAX
+ */
+int jent_read_raw(struct rand_data *entropy_collector, __u64 *deltas, size_t n)
+{
+#define JENT_RAW_RCT_CUTOFF 21
+	size_t i;
+
+	if (NULL == entropy_collector)
+		return -2;
+	if (NULL != entropy_collector->afalg)
+		return -3;
+	if (entropy_collector->fips_fail)
+		return -1;
+	if (INT_MAX < n)
+		return -4;
+
+	/* priming of the ->prev_time value */
+	jent_measure_jitter(entropy_collector, NULL);
+
+	for (i = 0; i < n; i++) {
+		jent_measure_jitter(entropy_collector, &deltas[i]);
+
+		if (!entropy_collector->raw_rep ||
+		    deltas[i] != entropy_collector->raw_last_delta) {
+			entropy_collector->raw_last_delta = deltas[i];
+			entropy_collector->raw_rep = 1;
+			continue;
+		}
+		if (JENT_RAW_RCT_CUTOFF <= ++entropy_collector->raw_rep) {
+			if (jent_fips_enabled())
+				entropy_collector->fips_fail = 1;
+			return -1;
+		}
+	}
+
+	return n;
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_read_raw);
+#endif
+
+/*
+ * Calibrate the worst case latency to generate one 64 bit word.
+ *
+ * The calibration generates @rounds words and records the highest time
+ * needed per jent_measure_jitter invocation, including the share of the
+ * stirring. That value is multiplied with the maximum number of
+ * invocations one word can need. This number is only bounded when the
+ * entropy collector was allocated with JENT_FIXED_COST: one priming
+ * invocation, two invocations per bit and two per permitted rejection.
+ *
+ * The result is given in units of the timer (nanoseconds on Linux) and
+ * stored in ->latency_bound. Rounds in which the seconds part of the time
+ * stamp changes are skipped as they do not yield a usable delta.
+ *
+ * @entropy_collector: entropy collector allocated with JENT_FIXED_COST
+ * @rounds: number of words generated for the calibration
+ *
+ * return: latency bound or 0 if no bound can be given
+ */
+__u64 jent_latency_calibrate(struct rand_data *entropy_collector,
+			     unsigned int rounds)
+{
+	__u64 loops = 0;
+	__u64 max_invocations = 0;
+	__u64 max_cost = 0;
+	unsigned int i;
+
+	if (NULL == entropy_collector || !entropy_collector->fixed_cost)
+		return 0;
+
+	loops = (((DATA_SIZE_BITS - 1) / TIME_ENTROPY_BITS) + 1) *
+		entropy_collector->osr;
+	if (entropy_collector->disable_unbias)
+		max_invocations = 1 + loops;
+	else
+		max_invocations = 1 + 2 * (loops +
+					   entropy_collector->unbias_budget);
+
+	for (i = 0; i < rounds; i++) {
+		__u64 start = 0;
+		__u64 end = 0;
+		__u64 invocations = 0;
+		__u64 cost = 0;
+
+		jent_get_nstime(&start);
+		jent_gen_entropy(entropy_collector);
+		jent_get_nstime(&end);
+
+		if ((start >> 32) != (end >> 32) || end <= start)
+			continue;
+		if (entropy_collector->disable_unbias)
+			invocations = 1 + loops;
+		else
+			invocations = 1 + 2 * (loops +
+					       entropy_collector->unbias_rejects);
+		cost = ((end - start) + invocations - 1) / invocations;
+		if (cost > max_cost)
+			max_cost = cost;
+	}
+
+	/* do not leave the state used for calibration in the pool */
+	jent_gen_entropy(entropy_collector);
+
+	entropy_collector->latency_bound = max_cost * max_invocations;
+	return entropy_collector->latency_bound;
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_latency_calibrate);
+#endif
+
+/*
+ * Number of bits taken without Von-Neuman unbias because the rejection
+ * budget of JENT_FIXED_COST was used up, counted over the lifetime of the
+ * entropy collector. A growing value indicates a degrading noise source.
+ *
+ * @entropy_collector: entropy collector
+ *
+ * return: number of fallback bits, 0 without JENT_FIXED_COST
+ */
+__u64 jent_unbias_fallbacks(struct rand_data *entropy_collector)
+{
+	if (NULL == entropy_collector)
+		return 0;
+	return entropy_collector->unbias_fallbacks;
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_unbias_fallbacks);
+#endif
+
+#ifdef JENT_INSTRUMENT
+/*
+ * Enable runtime instrumentation of an entropy collector. Counters and
+ * histogram keep their values when features are changed; they are reset
+ * when the entropy collector is wiped.
+ *
+ * @features: JENT_INSTR_* flags, 0 disables all instrumentation
+ * @trace: callback for JENT_INSTR_TRACE invoked with every time delta
+ * @priv: argument passed to @trace
+ *
+ * return: 0 on success, -1 for unknown features or a missing callback
+ */
+int jent_instrument(struct rand_data *entropy_collector, unsigned int features,
+		    void (*trace)(void *priv, __u64 delta), void *priv)
+{
+	if (NULL == entropy_collector ||
+	    (features & ~(JENT_INSTR_COUNTERS | JENT_INSTR_HISTOGRAM |
+			  JENT_INSTR_TRACE)) ||
+	    ((features & JENT_INSTR_TRACE) && NULL == trace))
+		return -1;
+
+	entropy_collector->instr_trace = trace;
+	entropy_collector->instr_priv = priv;
+	entropy_collector->instrument = features;
+	return 0;
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_instrument);
+#endif
+#endif /* JENT_INSTRUMENT */
+
+#ifdef JENT_BENCH_STAGES
+/*
+ * Run one stage of the entropy collection @rounds times in a row. This
+ * allows a benchmark to wrap timers or hardware performance counters around
+ * a single stage without replicating its code. The stages operate on the
+ * state of @entropy_collector outside the regular entropy collection, so
+ * the function is only compiled into benchmark builds with
+ * JENT_BENCH_STAGES and the entropy collector must not be used for output
+ * afterwards.
+ *
+ *	JENT_STAGE_MEMACCESS	jent_memaccess
+ *	JENT_STAGE_TIMER	one time stamp
+ *	JENT_STAGE_SHUFFLE	loop count calculation of the folding
+ *	JENT_STAGE_FOLD		folding with the mean loop count
+ *	JENT_STAGE_MEASURE	jent_measure_jitter, i.e. all stages above
+ *	JENT_STAGE_UNBIAS	one Von-Neuman unbiased bit
+ *	JENT_STAGE_STIR		stirring of the pool
+ *	JENT_STAGE_GEN		one 64 bit word
+ *
+ * return: 0 on success, -1 for an unknown stage or no entropy collector
+ */
+int jent_stage_run(struct rand_data *entropy_collector, unsigned int stage,
+		   unsigned int rounds)
+{
+	__u64 time = 0;
+	__u64 folded = 0;
+	unsigned int i;
+
+	if (NULL == entropy_collector || NULL != entropy_collector->afalg ||
+	    JENT_STAGE_MAX <= stage)
+		return -1;
+
+	for (i = 0; i < rounds; i++) {
+		switch (stage) {
+		case JENT_STAGE_MEMACCESS:
+			jent_memaccess(entropy_collector);
+			break;
+		case JENT_STAGE_TIMER:
+			jent_get_nstime(&time);
+			break;
+		case JENT_STAGE_SHUFFLE:
+			jent_loop_shuffle(entropy_collector, MAX_FOLD_LOOP_BIT,
+					  MIN_FOLD_LOOP_BIT);
+			break;
+		case JENT_STAGE_FOLD:
+			jent_fold_time(entropy_collector, time, &folded,
+				       FIXED_FOLD_LOOP_CNT);
+			time += folded + 1;
+			break;
+		case JENT_STAGE_MEASURE:
+			jent_measure_jitter(entropy_collector, NULL);
+			break;
+		case JENT_STAGE_UNBIAS:
+			entropy_collector->unbias_rejects = 0;
+			jent_unbiased_bit(entropy_collector);
+			break;
+		case JENT_STAGE_STIR:
+			jent_stir_pool(entropy_collector);
+			break;
+		case JENT_STAGE_GEN:
+			jent_gen_entropy(entropy_collector);
+			break;
+		}
+	}
+
+	return 0;
+}
+#endif /* JENT_BENCH_STAGES */
+
 /***************************************************************************
  * Initialization logic
  ***************************************************************************/
 
-struct rand_data *jent_entropy_collector_alloc(unsigned int osr,
-					       unsigned int flags)
+static int jent_entropy_shuffle_test(void);
+
+/*
+ * Allocate and prime a new entropy collector. This is the actual allocation
+ * logic which is used by jent_entropy_collector_alloc when no pre-warmed
+ * entropy collector is available as well as by the collector cache itself.
+ */
+struct rand_data *_jent_entropy_collector_alloc(unsigned int osr,
+						unsigned int flags)
 {
 	struct rand_data *entropy_collector;
 
+	/* the time stamps must vary the loop shuffle on their own */
+	if ((flags & JENT_SINGLE_TIMESTAMP) && jent_entropy_shuffle_test())
+		return NULL;
+
 	entropy_collector = jent_zalloc(sizeof(struct rand_data));
 	if (NULL == entropy_collector)
 		return NULL;
 
 	if (!(flags & JENT_DISABLE_MEMORY_ACCESS)) {
+		/* a larger memory region only adds blocks, the number of
+		 * accesses per invocation stays the same and the walk covers
+		 * the region over successive invocations */
+		unsigned int shift = (flags & JENT_MEMORY_SHIFT_MASK) >> 8;
+
 		/* Allocate memory for adding variations based on memory
 		 * access
 		 */
 		entropy_collector->mem = 
-			(unsigned char *)jent_zalloc(JENT_MEMORY_SIZE);
+			(unsigned char *)jent_zalloc(JENT_MEMORY_SIZE << shift);
 		if (NULL == entropy_collector->mem) {
 			jent_zfree(entropy_collector, sizeof(struct rand_data));
 			return NULL;
 		}
 		entropy_collector->memblocksize = JENT_MEMORY_BLOCKSIZE;
-		entropy_collector->memblocks = JENT_MEMORY_BLOCKS;
+		entropy_collector->memblocks = JENT_MEMORY_BLOCKS << shift;
 		entropy_collector->memaccessloops = JENT_MEMORY_ACCESSLOOPS;
 	}
 
@@ -530,46 +908,207 @@ struct rand_data *jent_entropy_collector_alloc(unsigned int osr,
 	if (0 == osr)
 		osr = 1; /* minimum sampling rate is 1 */
 	entropy_collector->osr = osr;
+	entropy_collector->flags = flags;
 
 	entropy_collector->stir = 1;
 	if (flags & JENT_DISABLE_STIR)
 		entropy_collector->stir = 0;
 	if (flags & JENT_DISABLE_UNBIAS)
 		entropy_collector->disable_unbias = 1;
+	if (flags & JENT_SINGLE_TIMESTAMP)
+		entropy_collector->single_timestamp = 1;
+	if (flags & JENT_FIXED_COST) {
+		entropy_collector->fixed_cost = 1;
+		/* twice the expected number of rejections of an unbiased
+		 * source which rejects half of all pairs */
+		entropy_collector->unbias_budget =
+			2 * (((DATA_SIZE_BITS - 1) / TIME_ENTROPY_BITS) + 1) * osr;
+	}
 
+	_jent_entropy_collector_prime(entropy_collector);
+
+	return entropy_collector;
+}
+
+/*
+ * Prime a new or wiped entropy collector before it is used.
+ */
+void _jent_entropy_collector_prime(struct rand_data *entropy_collector)
+{
 	/* fill the data pad with non-zero values */
 	jent_gen_entropy(entropy_collector);
 
 	/* initialize the FIPS 140-2 continuous test if needed */
 	jent_fips_test(entropy_collector);
-
-	return entropy_collector;
 }
-#if defined(__KERNEL__) && !defined(MODULE)
-EXPORT_SYMBOL(jent_entropy_collector_alloc);
+
+/*
+ * Clear all state of an entropy collector that was derived from its use
+ * while keeping the configuration and the allocated memory. The entropy
+ * collector must be primed with _jent_entropy_collector_prime before it is
+ * used again.
+ */
+void _jent_entropy_collector_wipe(struct rand_data *entropy_collector)
+{
+	entropy_collector->data = 0;
+	entropy_collector->prev_time = 0;
+	entropy_collector->old_data = 0;
+	entropy_collector->unbias_rejects = 0;
+	entropy_collector->unbias_fallbacks = 0;
+	entropy_collector->unbias_pairs = 0;
+	entropy_collector->unbias_discarded = 0;
+	entropy_collector->latency_bound = 0;
+	entropy_collector->raw_last_delta = 0;
+	entropy_collector->raw_rep = 0;
+#ifdef JENT_INSTRUMENT
+	/* the trace callback of a previous owner must never see the deltas of
+	 * the next one */
+	entropy_collector->instrument = 0;
+	entropy_collector->instr_trace = NULL;
+	entropy_collector->instr_priv = NULL;
+	entropy_collector->instr_samples = 0;
+	entropy_collector->instr_delta_sum = 0;
+	entropy_collector->instr_words = 0;
+	memset(entropy_collector->instr_hist, 0,
+	       sizeof(entropy_collector->instr_hist));
 #endif
+	if (NULL != entropy_collector->mem)
+		memset(entropy_collector->mem, 0,
+		       entropy_collector->memblocks *
+		       entropy_collector->memblocksize);
+	entropy_collector->memlocation = 0;
+}
 
-void jent_entropy_collector_free(struct rand_data *entropy_collector)
+void _jent_entropy_collector_free(struct rand_data *entropy_collector)
 {
 	if (NULL != entropy_collector->mem)
-		jent_zfree(entropy_collector->mem, JENT_MEMORY_SIZE);
+		jent_zfree(entropy_collector->mem,
+			   entropy_collector->memblocks *
+			   entropy_collector->memblocksize);
 	entropy_collector->mem = NULL;
 	if (NULL != entropy_collector)
 		jent_zfree(entropy_collector, sizeof(struct rand_data));
 	entropy_collector = NULL;
 }
+
+struct rand_data *jent_entropy_collector_alloc(unsigned int osr,
+					       unsigned int flags)
+{
+#ifndef __KERNEL__
+	struct rand_data *entropy_collector;
+
+	/* the timer is unusable here, let the kernel serve the reads */
+	if ((flags & JENT_AFALG_FALLBACK) && jent_entropy_init())
+		return jent_afalg_collector_alloc(osr, flags);
+
+	/* take a pre-warmed entropy collector if the cache is enabled */
+	entropy_collector = jent_collector_cache_get(osr, flags);
+	if (NULL != entropy_collector)
+		return entropy_collector;
+#endif
+
+	return _jent_entropy_collector_alloc(osr, flags);
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_entropy_collector_alloc);
+#endif
+
+void jent_entropy_collector_free(struct rand_data *entropy_collector)
+{
+#ifndef __KERNEL__
+	if (NULL != entropy_collector && NULL != entropy_collector->afalg) {
+		jent_afalg_collector_free(entropy_collector);
+		return;
+	}
+	/* hand the entropy collector back to the cache for re-priming */
+	if (!jent_collector_cache_put(entropy_collector))
+		return;
+#endif
+
+	_jent_entropy_collector_free(entropy_collector);
+}
 #if defined(__KERNEL__) && !defined(MODULE)
 EXPORT_SYMBOL(jent_entropy_collector_free);
 #endif
 
-int jent_entropy_init(void)
+/* TESTLOOPCOUNT needs some loops to identify edge systems. 100 is
+ * definitely too little. */
+#define TESTLOOPCOUNT 300
+#define CLEARCACHE 100
+
+/*
+ * Sequential evaluation of the timer tests.
+ *
+ * The regular test always performs TESTLOOPCOUNT loops. The sequential test
+ * evaluates the results every JENT_SEQ_STAGE loops once JENT_SEQ_MIN loops
+ * are performed. It stops as soon as all criteria pass with a clear margin
+ * to the thresholds the regular test applies: the upper (or lower) 99%
+ * confidence bound of every observed proportion keeps away from the
+ * respective threshold even with JENT_SEQ_MIN loops:
+ *
+ *	- no time stamp ran backwards
+ *	- at most 50% of the deltas are multiples of 100 (threshold: 90%)
+ *	- at least 50% of the deltas differ from their predecessor and the
+ *	  delta of deltas is on average at least 4 * TIME_ENTROPY_BITS
+ *
+ * If the results are marginal, testing continues up to JENT_SEQ_MAX loops,
+ * i.e. three times as many as the regular test performs, before the
+ * thresholds of the regular test are applied.
+ *
+ * The variation of the loop shuffle does not hold up testing: it only
+ * decides about ->shuffle_ret for JENT_SINGLE_TIMESTAMP collectors, which
+ * is evaluated with the loops performed once testing stops.
+ *
+ * Return:
+ * 1 if testing can stop, 0 if more loops are needed
+ */
+#define JENT_SEQ_MIN 100
+#define JENT_SEQ_STAGE 50
+#define JENT_SEQ_MAX (3 * TESTLOOPCOUNT)
+static int jent_entropy_seq_done(struct jent_init_diag *diag)
+{
+	if (JENT_SEQ_MIN > diag->loops || (diag->loops % JENT_SEQ_STAGE))
+		return 0;
+	if (JENT_SEQ_MAX <= diag->loops)
+		return 1;
+
+	/* the monotonicity test can not recover from too many failures */
+	if (3 < diag->time_backwards)
+		return 1;
+
+	if (diag->time_backwards)
+		return 0;
+	if (diag->count_mod * 2 > diag->loops)
+		return 0;
+	if (diag->count_var * 2 < diag->loops)
+		return 0;
+	if ((diag->delta_sum / diag->loops) < 4 * TIME_ENTROPY_BITS)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Perform the timer tests and record the results in @diag.
+ *
+ * Input:
+ * @sequential use the sequential test instead of a fixed number of loops
+ *
+ * Return:
+ * 0 if the timer is usable, otherwise one of the error codes of
+ * jent_entropy_init
+ */
+static int jent_entropy_test(struct jent_init_diag *diag, int sequential)
 {
 	int i;
-	__u64 delta_sum = 0;
 	__u64 old_delta = 0;
-	int time_backwards = 0;
-	int count_var = 0;
-	int count_mod = 0;
+	__u64 old_shuffle = 0;
+	/* collector state used to verify the JENT_SINGLE_TIMESTAMP loop
+	 * shuffle -- ->data stays zero to test the time stamps only */
+	struct rand_data shuffle_ec;
+
+	memset(&shuffle_ec, 0, sizeof(shuffle_ec));
+	shuffle_ec.single_timestamp = 1;
 
 	/* We could perform statistical tests here, but the problem is
 	 * that we only have a few loop counts to do testing. These
@@ -587,15 +1126,15 @@ int jent_entropy_init(void)
 	 * check for CONFIG_X86_TSC, but it does not make much sense as the
 	 * following sanity checks verify that we have a high-resolution
 	 * timer. */
-	/* TESTLOOPCOUNT needs some loops to identify edge systems. 100 is
-	 * definitely too little. */
-#define TESTLOOPCOUNT 300
-#define CLEARCACHE 100
-	for (i = 0; (TESTLOOPCOUNT + CLEARCACHE) > i; i++) {
+	/* TESTLOOPCOUNT needs some loops to identify edge systems, see
+	 * above. */
+	diag->sequential = sequential;
+	for (i = 0; ; i++) {
 		__u64 time = 0;
 		__u64 time2 = 0;
 		__u64 folded = 0;
 		__u64 delta = 0;
+		__u64 shuffle = 0;
 
 		jent_get_nstime(&time);
 		jent_fold_time(NULL, time, &folded, 1<<MIN_FOLD_LOOP_BIT);
@@ -605,6 +1144,10 @@ int jent_entropy_init(void)
 		if (!time || !time2)
 			return ENOTIME;
 		delta = time2 - time;
+		if (!diag->min_delta || delta < diag->min_delta)
+			diag->min_delta = delta;
+		if (delta > diag->max_delta)
+			diag->max_delta = delta;
 		/* test whether timer is fine grained enough to provide
 		 * delta even when called shortly after each other -- this
 		 * implies that we also have a high resolution timer */
@@ -624,13 +1167,14 @@ int jent_entropy_init(void)
 		 * measurements. */
 		if (CLEARCACHE > i)
 			continue;
+		diag->loops++;
 
 		/* test whether we have an increasing timer */
 		if (!(time2 > time))
-			time_backwards++;
+			diag->time_backwards++;
 
 		if (!(delta % 100))
-			count_mod++;
+			diag->count_mod++;
 
 		/* ensure that we have a varying delta timer which is necessary
 		 * for the calculation of entropy -- perform this check
@@ -638,13 +1182,30 @@ int jent_entropy_init(void)
 		 * the old_data value */
 		if (i) {
 			if (delta != old_delta)
-				count_var++;
+				diag->count_var++;
 			if (delta > old_delta)
-				delta_sum += (delta - old_delta);
+				diag->delta_sum += (delta - old_delta);
 			else
-				delta_sum += (old_delta - delta);
+				diag->delta_sum += (old_delta - delta);
 		}
 		old_delta = delta;
+
+		/* JENT_SINGLE_TIMESTAMP derives the loop shuffle from the
+		 * time stamp of jent_measure_jitter -- ensure that the time
+		 * stamps alone let that shuffle vary */
+		shuffle_ec.prev_time = time2;
+		shuffle = jent_loop_shuffle(&shuffle_ec, MAX_FOLD_LOOP_BIT,
+					    MIN_FOLD_LOOP_BIT);
+		if (shuffle != old_shuffle)
+			diag->count_shuffle++;
+		old_shuffle = shuffle;
+
+		if (sequential) {
+			if (jent_entropy_seq_done(diag))
+				break;
+		} else if (TESTLOOPCOUNT <= diag->loops) {
+			break;
+		}
 	}
 
 	/* we allow up to three times the time running backwards.
@@ -652,30 +1213,186 @@ int jent_entropy_init(void)
 	 * if such an operation just happens to interfere with our test, it
 	 * should not fail. The value of 3 should cover the NTP case being
 	 * performed during our test run. */
-	if (3 < time_backwards)
+	if (3 < diag->time_backwards)
 		return ENOMONOTONIC;
 	/* Error if the time variances are always identical */
-	if (!delta_sum)
+	if (!diag->delta_sum)
 		return EVARVAR;
 
 	/* Variations of deltas of time must on average be larger
 	 * than TIME_ENTROPY_BITS to ensure the entropy estimation
 	 * implied with TIME_ENTROPY_BITS is preserved */
-	if (!(delta_sum / TESTLOOPCOUNT) > TIME_ENTROPY_BITS)
+	if ((diag->delta_sum / diag->loops) <= TIME_ENTROPY_BITS)
 		return EMINVARVAR;
 
 	/* Ensure that we have variations in the time stamp below 10 for at least
 	 * 10% of all checks -- on some platforms, the counter increments in
 	 * multiples of 100, but not always */
-	if ((TESTLOOPCOUNT/10 * 9) < count_mod)
+	if ((diag->loops/10 * 9) < diag->count_mod)
 		return ECOARSETIME;
 
+	/* The loop shuffle derived from the time stamps must change for at
+	 * least 10% of all checks. Only JENT_SINGLE_TIMESTAMP collectors
+	 * depend on this, so the result does not fail the timer tests but
+	 * refuses the allocation of such collectors. */
+	if ((diag->loops/10) > diag->count_shuffle)
+		diag->shuffle_ret = ESHUFFLE;
+
 	return 0;
 }
+
+/*
+ * The timer tests are only performed once per process. The result is kept
+ * together with the diagnostic data and returned to all later callers, so
+ * several users of the library in one process do not repeat the tests.
+ * jent_entropy_revalidate repeats the tests explicitly.
+ */
+#ifndef __KERNEL__
+static pthread_mutex_t jent_init_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static int jent_init_done = 0;
+static struct jent_init_diag jent_init_result;
+
+/* perform the timer tests and update the cached result -- lock held */
+static int jent_entropy_run_test(int sequential)
+{
+	struct jent_init_diag diag;
+
+	memset(&diag, 0, sizeof(diag));
+	diag.ret = jent_entropy_test(&diag, sequential);
+	jent_init_result = diag;
+	jent_init_done = 1;
+
+	return diag.ret;
+}
+
+int jent_entropy_init(void)
+{
+	int ret;
+
+#ifndef __KERNEL__
+	pthread_mutex_lock(&jent_init_lock);
+#endif
+	if (jent_init_done)
+		ret = jent_init_result.ret;
+	else
+		ret = jent_entropy_run_test(0);
+#ifndef __KERNEL__
+	pthread_mutex_unlock(&jent_init_lock);
+#endif
+
+	return ret;
+}
 #if defined(__KERNEL__) && !defined(MODULE)
 EXPORT_SYMBOL(jent_entropy_init);
 #endif
 
+/*
+ * Variant of jent_entropy_init using the sequential timer test: testing
+ * stops early on timers that clearly pass and is extended on timers with
+ * marginal results. If the timer tests were already performed in this
+ * process, the cached result is returned like for jent_entropy_init.
+ */
+int jent_entropy_init_seq(void)
+{
+	int ret;
+
+#ifndef __KERNEL__
+	pthread_mutex_lock(&jent_init_lock);
+#endif
+	if (jent_init_done)
+		ret = jent_init_result.ret;
+	else
+		ret = jent_entropy_run_test(1);
+#ifndef __KERNEL__
+	pthread_mutex_unlock(&jent_init_lock);
+#endif
+
+	return ret;
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_entropy_init_seq);
+#endif
+
+/*
+ * Repeat the timer tests, e.g. when the timer source may have changed,
+ * and replace the cached result of jent_entropy_init. The same kind of
+ * test as for the initialization is performed.
+ */
+int jent_entropy_revalidate(void)
+{
+	int ret;
+
+#ifndef __KERNEL__
+	pthread_mutex_lock(&jent_init_lock);
+#endif
+	ret = jent_entropy_run_test(jent_init_result.sequential);
+#ifndef __KERNEL__
+	pthread_mutex_unlock(&jent_init_lock);
+#endif
+
+	return ret;
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_entropy_revalidate);
+#endif
+
+/*
+ * Repeat the timer tests without touching the cached result, e.g. for a
+ * periodic self test whose transient failure shall not become the result
+ * of later jent_entropy_init calls.
+ */
+int jent_entropy_check(void)
+{
+	struct jent_init_diag diag;
+
+	memset(&diag, 0, sizeof(diag));
+	return jent_entropy_test(&diag, 0);
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_entropy_check);
+#endif
+
+/*
+ * Verify that the time stamps alone vary the loop shuffle as required by
+ * JENT_SINGLE_TIMESTAMP. If the timer tests were not performed yet, they
+ * are performed now.
+ */
+static int jent_entropy_shuffle_test(void)
+{
+	int ret;
+
+	jent_entropy_init();
+#ifndef __KERNEL__
+	pthread_mutex_lock(&jent_init_lock);
+#endif
+	ret = jent_init_result.shuffle_ret;
+#ifndef __KERNEL__
+	pthread_mutex_unlock(&jent_init_lock);
+#endif
+
+	return ret;
+}
+
+/*
+ * Obtain the diagnostic data of the last timer tests. If the tests were not
+ * performed yet, they are performed now.
+ */
+void jent_entropy_init_diag(struct jent_init_diag *diag)
+{
+	jent_entropy_init();
+#ifndef __KERNEL__
+	pthread_mutex_lock(&jent_init_lock);
+#endif
+	*diag = jent_init_result;
+#ifndef __KERNEL__
+	pthread_mutex_unlock(&jent_init_lock);
+#endif
+}
+#if defined(__KERNEL__) && !defined(MODULE)
+EXPORT_SYMBOL(jent_entropy_init_diag);
+#endif
+
 /***************************************************************************
  * Statistical test logic not compiled for regular operation
  ***************************************************************************/
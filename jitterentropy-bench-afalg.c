@@ -0,0 +1,237 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Comparison with the kernel's jitterentropy_rng in jent-bench
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * The afalg mode generates output with the user space entropy collector
+ * and with the kernel's jitterentropy_rng, read through AF_ALG, one after
+ * the other on the same CPU. For each it reports the wall clock throughput
+ * and the throughput per CPU second. The CPU time is the thread CPU time
+ * which includes the time the kernel spends in read(), i.e. the entropy
+ * collection of jitterentropy_rng.
+ *
+ * If AF_ALG or jitterentropy_rng is not available, only the user space
+ * entropy collector is measured. If the timer tests of jent_entropy_init
+ * fail -- the hosts the AF_ALG fallback exists for -- only the kernel is
+ * measured.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "jitterentropy-bench.h"
+
+/* largest read the kernel serves at once */
+#define AFALG_MAX_READ 128
+
+static double Seconds = 3;
+static size_t Read_size = 32;
+static unsigned int Osr = 1;
+static unsigned int Runs = 1;
+static const char *Label;
+static const char *Results_file;
+static struct bench_results Results;
+
+struct afalg_result {
+	double bytes_per_sec;
+	double bytes_per_cpu_sec;
+};
+
+/* read from the user space entropy collector or, if @afalg, the kernel */
+static int afalg_measure(struct rand_data *ec, struct jent_afalg *afalg,
+			 struct afalg_result *res)
+{
+	char buf[AFALG_MAX_READ];
+	__u64 start = bench_ns(CLOCK_MONOTONIC), now = start;
+	__u64 cpu = bench_ns(CLOCK_THREAD_CPUTIME_ID);
+	__u64 end = start + (__u64)(Seconds * 1e9);
+	__u64 bytes = 0;
+	int ret;
+
+	do {
+		if (afalg)
+			ret = jent_afalg_read(afalg, buf, Read_size);
+		else
+			ret = jent_read_entropy(ec, buf, Read_size);
+		if (0 > ret)
+			return -EIO;
+		bytes += Read_size;
+		now = bench_ns(CLOCK_MONOTONIC);
+	} while (now < end);
+	cpu = bench_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+	memset(buf, 0, sizeof(buf));
+
+	res->bytes_per_sec = bytes * 1e9 / (now - start);
+	res->bytes_per_cpu_sec = cpu ? bytes * 1e9 / cpu : 0;
+	return 0;
+}
+
+static int afalg_report(const char *source, const struct afalg_result *res)
+{
+	char name[64];
+	int ret;
+
+	printf("%-8s %12.0f %14.0f\n", source, res->bytes_per_sec,
+	       res->bytes_per_cpu_sec);
+	snprintf(name, sizeof(name), "afalg.%s.throughput", source);
+	ret = bench_results_add(&Results, name, "bytes/s", 1,
+				res->bytes_per_sec);
+	snprintf(name, sizeof(name), "afalg.%s.per_cpu", source);
+	return ret ? ret : bench_results_add(&Results, name, "bytes/cpu-s", 1,
+					     res->bytes_per_cpu_sec);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "\nUser space entropy collector against the kernel's jitterentropy_rng\n\n");
+	fprintf(stderr, "Usage: jent-bench afalg [options]\n");
+	fprintf(stderr, "\t-s\tSeconds per source (default 3)\n");
+	fprintf(stderr, "\t-b\tBytes per read, at most %d (default 32)\n",
+		AFALG_MAX_READ);
+	fprintf(stderr, "\t-o\tOversampling rate of the user space entropy collector\n");
+	fprintf(stderr, "\t-R\tRepeated runs (default 1)\n");
+	fprintf(stderr, "\t-w\tWrite the results to this file\n");
+	fprintf(stderr, "\t-L\tLabel stored with the results, e.g. the library version\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"seconds", 1, 0, 's'},
+			{"bytes", 1, 0, 'b'},
+			{"osr", 1, 0, 'o'},
+			{"runs", 1, 0, 'R'},
+			{"write", 1, 0, 'w'},
+			{"label", 1, 0, 'L'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "s:b:o:R:w:L:", opts, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 's':
+			Seconds = strtod(optarg, NULL);
+			if (0 >= Seconds)
+				usage();
+			break;
+		case 'b':
+			Read_size = strtoul(optarg, NULL, 10);
+			if (!Read_size || AFALG_MAX_READ < Read_size)
+				usage();
+			break;
+		case 'o':
+			Osr = strtoul(optarg, NULL, 10);
+			break;
+		case 'R':
+			Runs = strtoul(optarg, NULL, 10);
+			if (!Runs || BENCH_MAX_RUNS < Runs)
+				usage();
+			break;
+		case 'w':
+			Results_file = optarg;
+			break;
+		case 'L':
+			Label = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+}
+
+int bench_afalg(int argc, char *argv[])
+{
+	struct rand_data *ec = NULL;
+	struct jent_afalg *afalg = NULL;
+	struct afalg_result res;
+	unsigned int run;
+	int init, ret = 0;
+
+	parse_opts(argc, argv);
+
+	/* the dispatcher left the initialization to this mode */
+	init = jent_entropy_init();
+	if (init) {
+		printf("The initialization of CPU Jitter RNG failed with error code %d, measuring the kernel only\n",
+		       init);
+	} else {
+		ec = jent_entropy_collector_alloc(Osr, 0);
+		if (!ec)
+			return -ENOMEM;
+	}
+	afalg = jent_afalg_open();
+	if (!afalg)
+		printf("Kernel jitterentropy_rng not available via AF_ALG: %s\n",
+		       strerror(errno));
+	if (!ec && !afalg) {
+		fprintf(stderr, "Neither entropy source is available\n");
+		return -ENODEV;
+	}
+
+	bench_results_init(&Results, "afalg", Label);
+	bench_results_meta(&Results, "config", "osr=%u seconds=%g read=%zu init=%d",
+			   Osr, Seconds, Read_size, init);
+	printf("%-8s %12s %14s\n", "source", "bytes/s", "bytes/CPU-s");
+	for (run = 0; !ret && run < Runs; run++) {
+		if (ec) {
+			ret = afalg_measure(ec, NULL, &res);
+			ret = ret ? ret : afalg_report("user", &res);
+		}
+		if (ret || !afalg)
+			continue;
+		ret = afalg_measure(NULL, afalg, &res);
+		ret = ret ? ret : afalg_report("kernel", &res);
+	}
+	if (ret)
+		fprintf(stderr, "Measurement failed: %s\n", strerror(-ret));
+	else if (Results_file)
+		ret = bench_results_write(&Results, Results_file);
+
+	jent_afalg_close(afalg);
+	jent_entropy_collector_free(ec);
+	return ret;
+}
@@ -0,0 +1,356 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Deterministic post-processing benchmark
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * jent-bench-mock links a jitterentropy-base.c compiled with
+ * JENT_MOCK_CLOCK, so every time stamp comes from the mock clock of
+ * jitterentropy-mock.c. For a given seed or capture, each configuration
+ * performs identical work on every run and produces identical output: the
+ * digest of the output is a regression check of the post-processing, and
+ * the time per byte is its cost without the real timer reads. The digest
+ * over all configurations is stored with the results, -c compares it
+ * against a known good value.
+ *
+ * The output of this tool is NOT random.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "jitterentropy-bench.h"
+#include "jitterentropy-capture.h"
+#include "jitterentropy-mock.h"
+
+static const struct {
+	const char *name;
+	unsigned int osr;
+	unsigned int flags;
+} Configs[] = {
+	{ "default", 1, 0 },
+	{ "osr3", 3, 0 },
+	{ "nounbias", 1, JENT_DISABLE_UNBIAS },
+	{ "nostir", 1, JENT_DISABLE_STIR },
+	{ "nomemory", 1, JENT_DISABLE_MEMORY_ACCESS },
+	{ "fixedcost", 1, JENT_FIXED_COST },
+	{ "singlets", 1, JENT_SINGLE_TIMESTAMP },
+};
+#define NR_CONFIGS (sizeof(Configs) / sizeof(Configs[0]))
+
+static __u64 Seed = 1;
+static __u64 Mean = 1000;
+static __u64 Sd = 30;
+static const char *Replay;
+static __u64 *Deltas;
+static size_t Nr_deltas;
+static size_t Bytes = 65536;
+static unsigned int Runs = 1;
+static const char *Label;
+static const char *Results_file;
+static int Check;
+static __u64 Expect;
+static struct bench_results Results;
+static __u64 Digest[NR_CONFIGS];
+
+/* the benchmark itself is timed with the real clock */
+static __u64 mock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void mock_reset(void)
+{
+	if (Deltas)
+		jent_mock_clock_replay(Deltas, Nr_deltas);
+	else
+		jent_mock_clock_model(Seed, Mean, Sd);
+}
+
+static int mock_load(const char *name)
+{
+	struct jent_capture *cap = jent_capture_open(name);
+	const struct jent_capture_meta *meta;
+	__u64 chunk;
+	int ret = 0;
+
+	if (!cap)
+		return -errno;
+	meta = jent_capture_get_meta(cap);
+	Deltas = malloc(meta->nr_chunks * meta->chunk_samples * sizeof(__u64));
+	if (!Deltas) {
+		jent_capture_close(cap);
+		return -ENOMEM;
+	}
+	for (chunk = 0; chunk < meta->nr_chunks; chunk++) {
+		ret = jent_capture_read_chunk(cap, chunk, Deltas + Nr_deltas);
+		if (0 > ret)
+			break;
+		Nr_deltas += ret;
+		ret = 0;
+	}
+	jent_capture_close(cap);
+	if (!ret && !Nr_deltas)
+		ret = -EINVAL;
+	return ret;
+}
+
+/* FNV-1a of the output */
+#define JENT_MOCK_FNV_INIT 0xcbf29ce484222325ULL
+static __u64 mock_digest(__u64 digest, const char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		digest ^= (unsigned char)buf[i];
+		digest *= 0x100000001b3ULL;
+	}
+	return digest;
+}
+
+static int mock_run(unsigned int config)
+{
+	struct rand_data *ec;
+	char buf[32];
+	__u64 digest = JENT_MOCK_FNV_INIT, start, end, reads, pairs, rejected;
+	size_t done;
+	char name[64];
+	double ns;
+	int ret;
+
+	mock_reset();
+	ec = jent_entropy_collector_alloc(Configs[config].osr,
+					  Configs[config].flags);
+	if (!ec)
+		return -ENOMEM;
+	/* do not count the priming of the allocation */
+	reads = jent_mock_clock_reads();
+	pairs = ec->unbias_pairs;
+	rejected = ec->unbias_discarded;
+
+	start = mock_ns();
+	for (done = 0; done < Bytes; done += sizeof(buf)) {
+		if (0 > jent_read_entropy(ec, buf, sizeof(buf))) {
+			jent_entropy_collector_free(ec);
+			return -EFAULT;
+		}
+		digest = mock_digest(digest, buf, sizeof(buf));
+	}
+	end = mock_ns();
+	reads = jent_mock_clock_reads() - reads;
+	pairs = ec->unbias_pairs - pairs;
+	rejected = ec->unbias_discarded - rejected;
+	jent_entropy_collector_free(ec);
+
+	/* all runs must agree, otherwise the output is not deterministic */
+	if (Digest[config] && Digest[config] != digest) {
+		fprintf(stderr, "Output of %s differs between runs\n",
+			Configs[config].name);
+		return -EPROTO;
+	}
+	Digest[config] = digest;
+
+	ns = (double)(end - start) / done;
+	printf("%-10s %10.1f %12.2f %9.2f%%  %016llx\n", Configs[config].name,
+	       ns, (double)reads / done,
+	       pairs ? 100.0 * rejected / pairs : 0,
+	       (unsigned long long)digest);
+
+	snprintf(name, sizeof(name), "mock.%s.time", Configs[config].name);
+	ret = bench_results_add(&Results, name, "ns/byte", 0, ns);
+	snprintf(name, sizeof(name), "mock.%s.reads", Configs[config].name);
+	return ret ? ret : bench_results_add(&Results, name, "reads/byte", 0,
+					     (double)reads / done);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "\nDeterministic post-processing benchmark of the CPU Jitter RNG\n\n");
+	fprintf(stderr, "Usage: jent-bench-mock [options]\n");
+	fprintf(stderr, "\t-S\tSeed of the delta model (default 1)\n");
+	fprintf(stderr, "\t-m\tMean delta of the model (default 1000)\n");
+	fprintf(stderr, "\t-d\tStandard deviation of the model (default 30)\n");
+	fprintf(stderr, "\t-r\tReplay the deltas of an indexed capture instead\n");
+	fprintf(stderr, "\t-b\tBytes generated per configuration (default 65536)\n");
+	fprintf(stderr, "\t-R\tRepeated runs (default 1)\n");
+	fprintf(stderr, "\t-w\tWrite the results to this file\n");
+	fprintf(stderr, "\t-L\tLabel stored with the results, e.g. the library version\n");
+	fprintf(stderr, "\t-c\tExpected digest over all configurations, exits with 2\n");
+	fprintf(stderr, "\t\tif the output differs\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	char *end;
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"seed", 1, 0, 'S'},
+			{"mean", 1, 0, 'm'},
+			{"sd", 1, 0, 'd'},
+			{"replay", 1, 0, 'r'},
+			{"bytes", 1, 0, 'b'},
+			{"runs", 1, 0, 'R'},
+			{"write", 1, 0, 'w'},
+			{"label", 1, 0, 'L'},
+			{"check", 1, 0, 'c'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "S:m:d:r:b:R:w:L:c:", opts,
+				&opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'S':
+			Seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			Mean = strtoull(optarg, NULL, 10);
+			if (!Mean)
+				usage();
+			break;
+		case 'd':
+			Sd = strtoull(optarg, NULL, 10);
+			break;
+		case 'r':
+			Replay = optarg;
+			break;
+		case 'b':
+			Bytes = strtoul(optarg, NULL, 10);
+			if (!Bytes)
+				usage();
+			break;
+		case 'R':
+			Runs = strtoul(optarg, NULL, 10);
+			if (!Runs || BENCH_MAX_RUNS < Runs)
+				usage();
+			break;
+		case 'w':
+			Results_file = optarg;
+			break;
+		case 'L':
+			Label = optarg;
+			break;
+		case 'c':
+			Expect = strtoull(optarg, &end, 16);
+			if (!*optarg || *end)
+				usage();
+			Check = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i, run;
+	__u64 digest;
+	char hex[17];
+	int ret = 0;
+
+	parse_opts(argc, argv);
+	if (Replay) {
+		ret = mock_load(Replay);
+		if (ret) {
+			fprintf(stderr, "Cannot read capture %s: %s\n", Replay,
+				strerror(-ret));
+			return 1;
+		}
+	}
+
+	/* the health tests of the initialization see the mock clock, too */
+	mock_reset();
+	ret = jent_entropy_init();
+	if (ret) {
+		fprintf(stderr, "The initialization with the mock clock failed with error code %d\n", ret);
+		return 1;
+	}
+
+	bench_results_init(&Results, "mock", Label);
+	if (Replay)
+		bench_results_meta(&Results, "config", "replay=%s deltas=%zu bytes=%zu",
+				   Replay, Nr_deltas, Bytes);
+	else
+		bench_results_meta(&Results, "config",
+				   "seed=%llu mean=%llu sd=%llu bytes=%zu",
+				   (unsigned long long)Seed,
+				   (unsigned long long)Mean,
+				   (unsigned long long)Sd, Bytes);
+
+	printf("%-10s %10s %12s %10s  %s\n", "config", "ns/byte", "reads/byte",
+	       "rejected", "output digest");
+	for (run = 0; !ret && run < Runs; run++) {
+		for (i = 0; !ret && i < NR_CONFIGS; i++)
+			ret = mock_run(i);
+	}
+	if (ret) {
+		fprintf(stderr, "Benchmark failed: %s\n", strerror(-ret));
+		goto out;
+	}
+
+	/* one digest of the configuration digests covers the whole output */
+	digest = JENT_MOCK_FNV_INIT;
+	for (i = 0; i < NR_CONFIGS; i++)
+		digest = mock_digest(digest, (const char *)&Digest[i],
+				     sizeof(Digest[i]));
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)digest);
+	printf("output digest %s\n", hex);
+	bench_results_meta(&Results, "digest", "%s", hex);
+	if (Results_file)
+		ret = bench_results_write(&Results, Results_file);
+	if (!ret && Check && Expect != digest) {
+		fprintf(stderr, "The output digest %s does not match the expected %016llx\n",
+			hex, (unsigned long long)Expect);
+		ret = 2;
+	}
+
+out:
+	free(Deltas);
+	return (0 > ret) ? 1 : ret;
+}
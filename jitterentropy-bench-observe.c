@@ -0,0 +1,408 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Observer-effect validation of the runtime instrumentation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Every instrumentation probe in jent_measure_jitter runs between two time
+ * stamps and therefore becomes part of the time delta the entropy is taken
+ * from. The probes only exist in builds with JENT_INSTRUMENT, so this tool
+ * links against its own instrumented build of the library. It captures raw time deltas of one entropy collector
+ * with an instrumentation feature off (A) and on (B) and compares the two
+ * distributions with
+ *
+ *	- the two-sample Kolmogorov-Smirnov test of the raw deltas,
+ *	- a chi-square test of homogeneity over equiprobable bins of the
+ *	  pooled deltas and
+ *	- the MCV min-entropy estimate of the low 8 bits of the deltas.
+ *
+ * A and B are captured in alternating blocks so that a slow drift of the
+ * host, e.g. a frequency change, affects both the same way. A control run
+ * compares A against A to show whether the host is quiet enough for the
+ * comparison. A feature fails if either test rejects at the significance
+ * level or if it costs more min-entropy than the tolerance.
+ *
+ * The tool exits with 2 if a feature fails and with 3 if the control run
+ * fails, i.e. the result is inconclusive.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <math.h>
+
+#include "jitterentropy.h"
+#include "jitterentropy-estimate.h"
+
+#define OBSERVE_BLOCK 100
+#define OBSERVE_BINS 64
+
+static __u64 Trace_sum;
+
+/* the cheapest meaningful trace consumer */
+static void observe_trace(void *priv, __u64 delta)
+{
+	*(__u64 *)priv += delta;
+}
+
+static const struct {
+	const char *name;
+	unsigned int features;
+} Features[] = {
+	{ "control", 0 },
+	{ "counters", JENT_INSTR_COUNTERS },
+	{ "histogram", JENT_INSTR_HISTOGRAM },
+	{ "trace", JENT_INSTR_TRACE },
+	{ "all", JENT_INSTR_COUNTERS | JENT_INSTR_HISTOGRAM |
+		 JENT_INSTR_TRACE },
+};
+#define NR_FEATURES (sizeof(Features) / sizeof(Features[0]))
+
+static size_t Samples = 200000;
+static double Alpha = 0.001;
+static double Tolerance = 0.5;
+static unsigned int Osr = 1;
+static const char *Only;
+
+static int cmp_u64(const void *a, const void *b)
+{
+	__u64 x = *(const __u64 *)a, y = *(const __u64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* asymptotic p-value of the two-sample KS statistic @d */
+static double ks_pvalue(double d, size_t n, size_t m)
+{
+	double ne = (double)n * m / (n + m);
+	double lambda = (sqrt(ne) + 0.12 + 0.11 / sqrt(ne)) * d;
+	double p = 0, sign = 1;
+	int k;
+
+	if (lambda < 0.2)
+		return 1;
+	for (k = 1; k <= 100; k++) {
+		double term = exp(-2.0 * k * k * lambda * lambda);
+
+		p += sign * term;
+		sign = -sign;
+		if (term < 1e-12)
+			break;
+	}
+	p *= 2;
+	return (p > 1) ? 1 : ((p < 0) ? 0 : p);
+}
+
+/* both arrays must be sorted */
+static double ks_stat(const __u64 *a, size_t n, const __u64 *b, size_t m)
+{
+	size_t i = 0, j = 0;
+	double d = 0;
+
+	while (i < n && j < m) {
+		__u64 x = (a[i] < b[j]) ? a[i] : b[j];
+		double diff;
+
+		while (i < n && a[i] == x)
+			i++;
+		while (j < m && b[j] == x)
+			j++;
+		diff = fabs((double)i / n - (double)j / m);
+		if (diff > d)
+			d = diff;
+	}
+	return d;
+}
+
+/* upper tail of the chi-square distribution, Wilson-Hilferty */
+static double chi2_pvalue(double x, unsigned int df)
+{
+	double k = df, z;
+
+	if (!df)
+		return 1;
+	z = (pow(x / k, 1.0 / 3) - (1 - 2 / (9 * k))) / sqrt(2 / (9 * k));
+	return 0.5 * erfc(z / sqrt(2));
+}
+
+/* index of the first edge >= @x */
+static unsigned int chi2_bin(const __u64 *edges, unsigned int nr, __u64 x)
+{
+	unsigned int lo = 0, hi = nr - 1;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (edges[mid] < x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Chi-square test of homogeneity over bins holding about the same share of
+ * the pooled deltas. Ties may merge bins.
+ */
+static double chi2_test(const __u64 *a, const __u64 *b, size_t n,
+			__u64 *pooled, unsigned int *df)
+{
+	__u64 edges[OBSERVE_BINS];
+	size_t ca[OBSERVE_BINS], cb[OBSERVE_BINS];
+	unsigned int nr = 0, k;
+	double chi2 = 0;
+	size_t i;
+
+	memcpy(pooled, a, n * sizeof(__u64));
+	memcpy(pooled + n, b, n * sizeof(__u64));
+	qsort(pooled, 2 * n, sizeof(__u64), cmp_u64);
+	for (k = 0; k < OBSERVE_BINS; k++) {
+		__u64 edge = pooled[(k + 1) * 2 * n / OBSERVE_BINS - 1];
+
+		if (!nr || edges[nr - 1] != edge)
+			edges[nr++] = edge;
+	}
+	memset(ca, 0, sizeof(ca));
+	memset(cb, 0, sizeof(cb));
+	for (i = 0; i < n; i++) {
+		ca[chi2_bin(edges, nr, a[i])]++;
+		cb[chi2_bin(edges, nr, b[i])]++;
+	}
+	/* equal sample sizes: the expectation is the mean of both counts */
+	for (k = 0; k < nr; k++) {
+		double e = (ca[k] + cb[k]) / 2.0;
+
+		if (e > 0)
+			chi2 += ((ca[k] - e) * (ca[k] - e) +
+				 (cb[k] - e) * (cb[k] - e)) / e;
+	}
+	*df = nr - 1;
+	return chi2;
+}
+
+static double observe_min_entropy(const __u64 *deltas, size_t n, __u8 *sym)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		sym[i] = deltas[i] & 0xff;
+	return jent_est_mcv_sym(sym, n);
+}
+
+/* capture A and B in alternating blocks */
+static int observe_capture(struct rand_data *ec, unsigned int features,
+			   __u64 *a, __u64 *b)
+{
+	size_t done;
+
+	for (done = 0; done < Samples; done += OBSERVE_BLOCK) {
+		size_t len = Samples - done;
+
+		if (len > OBSERVE_BLOCK)
+			len = OBSERVE_BLOCK;
+		jent_instrument(ec, 0, NULL, NULL);
+		if (0 > jent_read_raw(ec, a + done, len))
+			return -EFAULT;
+		jent_instrument(ec, features, observe_trace, &Trace_sum);
+		if (0 > jent_read_raw(ec, b + done, len))
+			return -EFAULT;
+	}
+	jent_instrument(ec, 0, NULL, NULL);
+	return 0;
+}
+
+static void usage(void)
+{
+	unsigned int i;
+
+	fprintf(stderr, "\nObserver-effect validation of the CPU Jitter RNG instrumentation\n\n");
+	fprintf(stderr, "Usage: jent-bench-observe [options]\n");
+	fprintf(stderr, "\t-n\tTime deltas captured per side (default 200000)\n");
+	fprintf(stderr, "\t-a\tSignificance level of the KS and chi-square tests\n");
+	fprintf(stderr, "\t\t(default 0.001)\n");
+	fprintf(stderr, "\t-e\tTolerated min-entropy loss in bits (default 0.5)\n");
+	fprintf(stderr, "\t-o\tOversampling rate of the entropy collector\n");
+	fprintf(stderr, "\t-F\tTest only the named feature:");
+	for (i = 1; i < NR_FEATURES; i++)
+		fprintf(stderr, " %s", Features[i].name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Exits with 2 if a feature fails, 3 if the control fails\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"samples", 1, 0, 'n'},
+			{"alpha", 1, 0, 'a'},
+			{"tolerance", 1, 0, 'e'},
+			{"osr", 1, 0, 'o'},
+			{"feature", 1, 0, 'F'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "n:a:e:o:F:", opts, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'n':
+			Samples = strtoul(optarg, NULL, 10);
+			if (OBSERVE_BINS * 4 > Samples)
+				usage();
+			break;
+		case 'a':
+			Alpha = strtod(optarg, NULL);
+			if (0 >= Alpha || 1 <= Alpha)
+				usage();
+			break;
+		case 'e':
+			Tolerance = strtod(optarg, NULL);
+			if (0 > Tolerance)
+				usage();
+			break;
+		case 'o':
+			Osr = strtoul(optarg, NULL, 10);
+			break;
+		case 'F':
+			Only = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+}
+
+int main(int argc, char *argv[])
+{
+	struct rand_data *ec = NULL;
+	__u64 *a, *b, *pooled;
+	__u8 *sym;
+	unsigned int i, failed = 0, control_failed = 0;
+	int ret = 0;
+
+	parse_opts(argc, argv);
+	for (i = 1; Only && i < NR_FEATURES; i++) {
+		if (!strcmp(Only, Features[i].name))
+			break;
+	}
+	if (NR_FEATURES == i)
+		usage();
+
+	ret = jent_entropy_init();
+	if (ret) {
+		fprintf(stderr, "The initialization of CPU Jitter RNG failed with error code %d\n", ret);
+		return 1;
+	}
+
+	a = malloc(Samples * sizeof(__u64));
+	b = malloc(Samples * sizeof(__u64));
+	pooled = malloc(2 * Samples * sizeof(__u64));
+	sym = malloc(Samples);
+	ec = jent_entropy_collector_alloc(Osr, 0);
+	if (!a || !b || !pooled || !sym || !ec) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	printf("%zu time deltas per side, alpha %g, min-entropy tolerance %g bits\n",
+	       Samples, Alpha, Tolerance);
+	printf("%-10s %10s %8s %10s %8s %8s %8s %8s %s\n", "feature",
+	       "median", "KS D", "KS p", "chi2/df", "chi2 p", "H_min A",
+	       "H_min B", "verdict");
+	for (i = 0; i < NR_FEATURES; i++) {
+		double med_a, med_b, d, p_ks, chi2, p_chi2, h_a, h_b;
+		unsigned int df;
+		int fail;
+
+		if (i && Only && strcmp(Only, Features[i].name))
+			continue;
+		ret = observe_capture(ec, Features[i].features, a, b);
+		if (ret) {
+			fprintf(stderr, "Capturing time deltas failed\n");
+			goto out;
+		}
+		h_a = observe_min_entropy(a, Samples, sym);
+		h_b = observe_min_entropy(b, Samples, sym);
+		chi2 = chi2_test(a, b, Samples, pooled, &df);
+		p_chi2 = chi2_pvalue(chi2, df);
+		qsort(a, Samples, sizeof(__u64), cmp_u64);
+		qsort(b, Samples, sizeof(__u64), cmp_u64);
+		d = ks_stat(a, Samples, b, Samples);
+		p_ks = ks_pvalue(d, Samples, Samples);
+		/* the mean is dominated by preemptions, use the median */
+		med_a = a[Samples / 2];
+		med_b = b[Samples / 2];
+
+		fail = (p_ks < Alpha || p_chi2 < Alpha ||
+			h_a - h_b > Tolerance);
+		if (fail && i)
+			failed++;
+		else if (fail)
+			control_failed = 1;
+		printf("%-10s %+9.1f%% %8.4f %10.3g %8.2f %8.3g %8.3f %8.3f %s\n",
+		       Features[i].name,
+		       100.0 * (med_b - med_a) / (med_a ? med_a : 1), d,
+		       p_ks, df ? chi2 / df : 0, p_chi2, h_a, h_b,
+		       fail ? "FAIL" : "pass");
+	}
+
+	if (control_failed) {
+		printf("The control run failed, the host is too noisy for a verdict\n");
+		ret = 3;
+	} else if (failed) {
+		printf("%u instrumentation feature(s) shift the time deltas\n",
+		       failed);
+		ret = 2;
+	}
+
+out:
+	if (ec)
+		jent_entropy_collector_free(ec);
+	free(a);
+	free(b);
+	free(pooled);
+	free(sym);
+	return (0 > ret) ? 1 : ret;
+}
@@ -0,0 +1,398 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Hardware performance counter mode of jent-bench
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Wall clock numbers tell how fast a host generates output, not why. The
+ * perf mode runs each stage of the entropy collection on its own via
+ * jent_stage_run and attributes cycles, instructions, cache misses, branch
+ * misses and data TLB misses to it using perf_event_open.
+ *
+ * The folding performs the loop shuffle itself unless the entropy collector
+ * uses JENT_FIXED_COST, so the fold stage runs on such a collector to not
+ * count the shuffle twice. The share of the stages making up one time
+ * delta measurement is given relative to the measure stage.
+ *
+ * Each counter is opened on its own so that a CPU or hypervisor lacking one
+ * event does not take down the others. If the kernel does not permit perf
+ * events at all (see /proc/sys/kernel/perf_event_paranoid), only the wall
+ * clock time per stage is reported. Counters are restricted to user space
+ * so that a paranoid setting of 2 suffices; time spent in the kernel, e.g.
+ * a trapping clock_gettime in a virtual machine, only shows as wall clock
+ * time.
+ */
+
+#define _GNU_SOURCE
+/* jent_stage_run is only provided by jitterentropy-base-bench.o */
+#define JENT_BENCH_STAGES
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "jitterentropy-bench.h"
+
+static const struct {
+	const char *name;
+	__u32 type;
+	__u64 config;
+} Events[] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ "br-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ "dtlb-miss", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+	  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+#define NR_EVENTS (sizeof(Events) / sizeof(Events[0]))
+
+static const struct {
+	const char *name;
+	unsigned int stage;
+	int sample;		/* part of every time delta measurement */
+} Stages[] = {
+	{ "memaccess", JENT_STAGE_MEMACCESS, 1 },
+	{ "timer", JENT_STAGE_TIMER, 1 },
+	{ "shuffle", JENT_STAGE_SHUFFLE, 1 },
+	{ "fold", JENT_STAGE_FOLD, 1 },
+	{ "measure", JENT_STAGE_MEASURE, 0 },
+	{ "unbias", JENT_STAGE_UNBIAS, 0 },
+	{ "stir", JENT_STAGE_STIR, 0 },
+	{ "gen", JENT_STAGE_GEN, 0 },
+};
+#define NR_STAGES (sizeof(Stages) / sizeof(Stages[0]))
+
+/* result of one stage, counters are per invocation, < 0 if unavailable */
+struct perf_result {
+	double ns;
+	double count[NR_EVENTS];
+};
+
+static double Millis = 200;
+static unsigned int Osr = 1;
+static int No_perf;
+static unsigned int Runs = 1;
+static const char *Label;
+static const char *Results_file;
+static struct bench_results Results;
+
+static int perf_open(unsigned int event)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = Events[event].type;
+	attr.config = Events[event].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* counter value scaled up for multiplexing, < 0 if it never ran */
+static double perf_read(int fd)
+{
+	__u64 val[3];
+
+	if (sizeof(val) != read(fd, val, sizeof(val)) || !val[2])
+		return -1;
+	if (val[2] < val[1])
+		return (double)val[0] * val[1] / val[2];
+	return val[0];
+}
+
+/* number of invocations of a stage taking about Millis milliseconds */
+static unsigned int perf_rounds(struct rand_data *ec, unsigned int stage)
+{
+	unsigned int rounds = 1;
+	__u64 start, elapsed;
+
+	while (1) {
+		start = bench_ns(CLOCK_MONOTONIC);
+		jent_stage_run(ec, stage, rounds);
+		elapsed = bench_ns(CLOCK_MONOTONIC) - start;
+		if (elapsed >= 10000000 || rounds >= (1U << 30))
+			break;
+		rounds *= 2;
+	}
+	rounds = (double)rounds * Millis * 1e6 / (elapsed ? elapsed : 1);
+	return rounds ? rounds : 1;
+}
+
+static void perf_stage(struct rand_data *ec, unsigned int stage,
+		       const int *fds, struct perf_result *res)
+{
+	unsigned int rounds = perf_rounds(ec, stage);
+	unsigned int i;
+	__u64 start, end;
+
+	for (i = 0; i < NR_EVENTS; i++) {
+		if (0 <= fds[i]) {
+			ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+	start = bench_ns(CLOCK_MONOTONIC);
+	jent_stage_run(ec, stage, rounds);
+	end = bench_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < NR_EVENTS; i++) {
+		if (0 <= fds[i])
+			ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+
+	res->ns = (double)(end - start) / rounds;
+	for (i = 0; i < NR_EVENTS; i++) {
+		res->count[i] = -1;
+		if (0 <= fds[i]) {
+			double val = perf_read(fds[i]);
+
+			if (0 <= val)
+				res->count[i] = val / rounds;
+		}
+	}
+}
+
+/*
+ * Store the result of one run and add it to the sum in @total. A counter
+ * unavailable in any run stays unavailable.
+ */
+static void perf_record(const char *stage, const struct perf_result *res,
+			struct perf_result *total)
+{
+	char name[64];
+	unsigned int i;
+
+	snprintf(name, sizeof(name), "perf.%s.time", stage);
+	bench_results_add(&Results, name, "ns", 0, res->ns);
+	total->ns += res->ns;
+	for (i = 0; i < NR_EVENTS; i++) {
+		if (0 > res->count[i] || 0 > total->count[i]) {
+			total->count[i] = -1;
+			continue;
+		}
+		snprintf(name, sizeof(name), "perf.%s.%s", stage,
+			 Events[i].name);
+		bench_results_add(&Results, name, "events", 0, res->count[i]);
+		total->count[i] += res->count[i];
+	}
+}
+
+static void perf_print(const struct perf_result *res, double sample_ns,
+		       int sample)
+{
+	unsigned int i;
+
+	printf(" %10.1f", res->ns);
+	if (sample && 0 < sample_ns)
+		printf(" %6.1f%%", 100.0 * res->ns / sample_ns);
+	else
+		printf(" %7s", "-");
+	for (i = 0; i < NR_EVENTS; i++) {
+		if (0 > res->count[i])
+			printf(" %10s", "-");
+		else
+			printf(" %10.1f", res->count[i]);
+	}
+	if (0 < res->count[0] && 0 <= res->count[1])
+		printf(" %6.2f", res->count[1] / res->count[0]);
+	else
+		printf(" %6s", "-");
+	printf("\n");
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "\nPer-stage hardware counter attribution of the CPU Jitter RNG\n\n");
+	fprintf(stderr, "Usage: jent-bench perf [options]\n");
+	fprintf(stderr, "\t-m\tMilliseconds spent per stage (default 200)\n");
+	fprintf(stderr, "\t-o\tOversampling rate of the entropy collector\n");
+	fprintf(stderr, "\t-W\tWall clock time only, do not open perf events\n");
+	fprintf(stderr, "\t-R\tRepeated runs, the table shows the mean (default 1)\n");
+	fprintf(stderr, "\t-w\tWrite the results to this file\n");
+	fprintf(stderr, "\t-L\tLabel stored with the results, e.g. the library version\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"millis", 1, 0, 'm'},
+			{"osr", 1, 0, 'o'},
+			{"wallclock", 0, 0, 'W'},
+			{"runs", 1, 0, 'R'},
+			{"write", 1, 0, 'w'},
+			{"label", 1, 0, 'L'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "m:o:WR:w:L:", opts, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'm':
+			Millis = strtod(optarg, NULL);
+			if (0 >= Millis)
+				usage();
+			break;
+		case 'o':
+			Osr = strtoul(optarg, NULL, 10);
+			break;
+		case 'W':
+			No_perf = 1;
+			break;
+		case 'R':
+			Runs = strtoul(optarg, NULL, 10);
+			if (!Runs || BENCH_MAX_RUNS < Runs)
+				usage();
+			break;
+		case 'w':
+			Results_file = optarg;
+			break;
+		case 'L':
+			Label = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+}
+
+int bench_perf(int argc, char *argv[])
+{
+	struct perf_result res[NR_STAGES];
+	struct rand_data *ec = NULL;
+	/* folding without the loop shuffle */
+	struct rand_data *fold_ec = NULL;
+	int fds[NR_EVENTS];
+	unsigned int i, run, nr_fds = 0;
+	double sample_ns = 0;
+	int err = 0;
+
+	parse_opts(argc, argv);
+
+	for (i = 0; i < NR_EVENTS; i++) {
+		fds[i] = No_perf ? -1 : perf_open(i);
+		if (0 <= fds[i])
+			nr_fds++;
+		else if (!err)
+			err = errno;
+	}
+	if (No_perf)
+		printf("Perf events disabled, wall clock time only\n");
+	else if (!nr_fds)
+		printf("Perf events not available (%s)%s, wall clock time only\n",
+		       strerror(err), (EACCES == err || EPERM == err) ?
+		       ", check /proc/sys/kernel/perf_event_paranoid" : "");
+	else if (nr_fds < NR_EVENTS)
+		printf("Some perf events not available (%s)\n", strerror(err));
+
+	ec = jent_entropy_collector_alloc(Osr, 0);
+	fold_ec = jent_entropy_collector_alloc(Osr, JENT_FIXED_COST);
+	if (!ec || !fold_ec) {
+		err = -ENOMEM;
+		goto out;
+	}
+	err = 0;
+
+	bench_results_init(&Results, "perf", Label);
+	bench_results_meta(&Results, "config", "osr=%u millis=%g perf=%s",
+			   Osr, Millis, nr_fds ? "yes" : "no");
+	memset(res, 0, sizeof(res));
+	for (run = 0; run < Runs; run++) {
+		for (i = 0; i < NR_STAGES; i++) {
+			struct perf_result one;
+
+			perf_stage((JENT_STAGE_FOLD == Stages[i].stage) ?
+				   fold_ec : ec, Stages[i].stage, fds, &one);
+			perf_record(Stages[i].name, &one, &res[i]);
+		}
+	}
+	for (i = 0; i < NR_STAGES; i++) {
+		unsigned int j;
+
+		res[i].ns /= Runs;
+		for (j = 0; j < NR_EVENTS; j++)
+			res[i].count[j] /= Runs;
+	}
+	/* Stages is ordered by the stage numbers */
+	sample_ns = res[JENT_STAGE_MEASURE].ns;
+
+	printf("Per invocation, share of the time delta measurement in %%:\n");
+	printf("%-10s %10s %7s", "stage", "ns", "share");
+	for (i = 0; i < NR_EVENTS; i++)
+		printf(" %10s", Events[i].name);
+	printf(" %6s\n", "IPC");
+	for (i = 0; i < NR_STAGES; i++) {
+		printf("%-10s", Stages[i].name);
+		perf_print(&res[i], sample_ns, Stages[i].sample);
+	}
+	if (0 < res[JENT_STAGE_MEASURE].ns)
+		printf("Time delta measurements per unbiased bit: %.2f\n",
+		       res[JENT_STAGE_UNBIAS].ns / res[JENT_STAGE_MEASURE].ns);
+
+	if (Results_file) {
+		err = bench_results_write(&Results, Results_file);
+		if (err)
+			fprintf(stderr, "Cannot write %s: %s\n", Results_file,
+				strerror(-err));
+	}
+
+out:
+	for (i = 0; i < NR_EVENTS; i++) {
+		if (0 <= fds[i])
+			close(fds[i]);
+	}
+	if (ec)
+		jent_entropy_collector_free(ec);
+	if (fold_ec)
+		jent_entropy_collector_free(fold_ec);
+	return err;
+}
@@ -0,0 +1,429 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Result store and compare mode of jent-bench
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Benchmark results are written as a line oriented text file so that they
+ * can be kept next to a fleet inventory, diffed and parsed by scripts:
+ *
+ *	jent-bench-results 1
+ *	meta <key> <value>
+ *	metric <name> <unit> <higher|lower> <runs> <value> ...
+ *
+ * The first line carries the format version; readers reject other
+ * versions. Keys, names and units contain no white space; a meta value
+ * extends to the end of its line. Metric values are the results of the
+ * individual runs in the order they were taken.
+ *
+ * The compare mode loads a baseline and a candidate result set and judges
+ * every metric present in both with Welch's t-test: a change is reported as
+ * significant if the 95% confidence interval of the difference of the means
+ * excludes zero and the change exceeds a minimal relative threshold. At
+ * least two runs per result set are needed for a verdict.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <math.h>
+#include <sys/utsname.h>
+
+#include "jitterentropy-bench.h"
+
+#define BENCH_RESULTS_MAGIC "jent-bench-results"
+#define BENCH_RESULTS_VERSION 1
+
+int bench_results_meta(struct bench_results *res, const char *key,
+		       const char *fmt, ...)
+{
+	unsigned int i;
+	va_list args;
+	char *val;
+
+	for (i = 0; i < res->nr_meta; i++) {
+		if (!strcmp(res->meta_key[i], key))
+			break;
+	}
+	if (BENCH_MAX_META <= i)
+		return -ENOSPC;
+	if (i == res->nr_meta) {
+		snprintf(res->meta_key[i], sizeof(res->meta_key[i]), "%s", key);
+		res->nr_meta++;
+	}
+	va_start(args, fmt);
+	vsnprintf(res->meta_val[i], sizeof(res->meta_val[i]), fmt, args);
+	va_end(args);
+	/* values must not break the line structure */
+	for (val = res->meta_val[i]; *val; val++) {
+		if ('\n' == *val || '\t' == *val)
+			*val = ' ';
+	}
+	return 0;
+}
+
+const char *bench_results_get_meta(const struct bench_results *res,
+				   const char *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < res->nr_meta; i++) {
+		if (!strcmp(res->meta_key[i], key))
+			return res->meta_val[i];
+	}
+	return NULL;
+}
+
+static void bench_cpu_model(char *model, size_t len)
+{
+	char line[256];
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	snprintf(model, len, "unknown");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		char *val = strchr(line, ':');
+
+		if (!val || strncmp(line, "model name", 10))
+			continue;
+		val += 1 + strspn(val + 1, " ");
+		val[strcspn(val, "\n")] = '\0';
+		snprintf(model, len, "%s", val);
+		break;
+	}
+	fclose(f);
+}
+
+/* start a result set with the metadata of the host */
+void bench_results_init(struct bench_results *res, const char *mode,
+			const char *label)
+{
+	struct utsname uts;
+	char model[128];
+	time_t now = time(NULL);
+	struct tm tm;
+
+	memset(res, 0, sizeof(*res));
+	bench_results_meta(res, "mode", "%s", mode);
+	if (label)
+		bench_results_meta(res, "label", "%s", label);
+	if (!uname(&uts)) {
+		bench_results_meta(res, "host", "%s", uts.nodename);
+		bench_results_meta(res, "kernel", "%s", uts.release);
+		bench_results_meta(res, "arch", "%s", uts.machine);
+	}
+	bench_cpu_model(model, sizeof(model));
+	bench_results_meta(res, "cpu", "%s", model);
+	bench_results_meta(res, "cpus", "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+	gmtime_r(&now, &tm);
+	bench_results_meta(res, "date", "%04d-%02d-%02dT%02d:%02d:%02dZ",
+			   tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+			   tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+/* append the value of one run to a metric, creating it on first use */
+int bench_results_add(struct bench_results *res, const char *name,
+		      const char *unit, int higher_better, double val)
+{
+	struct bench_metric *m = NULL;
+	unsigned int i;
+
+	for (i = 0; i < res->nr_metrics; i++) {
+		if (!strcmp(res->metric[i].name, name)) {
+			m = &res->metric[i];
+			break;
+		}
+	}
+	if (!m) {
+		if (BENCH_MAX_METRICS <= res->nr_metrics)
+			return -ENOSPC;
+		m = &res->metric[res->nr_metrics++];
+		snprintf(m->name, sizeof(m->name), "%s", name);
+		snprintf(m->unit, sizeof(m->unit), "%s", unit);
+		m->higher_better = higher_better;
+	}
+	if (BENCH_MAX_RUNS <= m->nr)
+		return -ENOSPC;
+	m->val[m->nr++] = val;
+	return 0;
+}
+
+int bench_results_write(const struct bench_results *res, const char *path)
+{
+	FILE *f = fopen(path, "w");
+	unsigned int i, j;
+	int ret = 0;
+
+	if (!f)
+		return -errno;
+	fprintf(f, "%s %d\n", BENCH_RESULTS_MAGIC, BENCH_RESULTS_VERSION);
+	for (i = 0; i < res->nr_meta; i++)
+		fprintf(f, "meta %s %s\n", res->meta_key[i], res->meta_val[i]);
+	for (i = 0; i < res->nr_metrics; i++) {
+		const struct bench_metric *m = &res->metric[i];
+
+		fprintf(f, "metric %s %s %s %u", m->name, m->unit,
+			m->higher_better ? "higher" : "lower", m->nr);
+		for (j = 0; j < m->nr; j++)
+			fprintf(f, " %.17g", m->val[j]);
+		fprintf(f, "\n");
+	}
+	if (ferror(f))
+		ret = -EIO;
+	if (fclose(f) && !ret)
+		ret = -errno;
+	return ret;
+}
+
+static int bench_results_parse_metric(struct bench_results *res, char *line)
+{
+	char name[64], unit[16], better[8];
+	unsigned int nr, i;
+	int pos = 0;
+
+	if (4 != sscanf(line, "%63s %15s %7s %u%n", name, unit, better, &nr,
+			&pos) ||
+	    (strcmp(better, "higher") && strcmp(better, "lower")))
+		return -EINVAL;
+	line += pos;
+	for (i = 0; i < nr; i++) {
+		char *end;
+		double val = strtod(line, &end);
+
+		if (end == line)
+			return -EINVAL;
+		line = end;
+		if (bench_results_add(res, name, unit, !strcmp(better, "higher"),
+				      val))
+			return -ENOSPC;
+	}
+	return 0;
+}
+
+int bench_results_read(struct bench_results *res, const char *path)
+{
+	char line[8192];
+	FILE *f = fopen(path, "r");
+	int version = 0;
+	int ret = 0;
+
+	if (!f)
+		return -errno;
+	memset(res, 0, sizeof(*res));
+	if (!fgets(line, sizeof(line), f) ||
+	    1 != sscanf(line, BENCH_RESULTS_MAGIC " %d", &version) ||
+	    BENCH_RESULTS_VERSION != version) {
+		ret = -EINVAL;
+		goto out;
+	}
+	while (!ret && fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (!strncmp(line, "meta ", 5)) {
+			char *key = line + 5;
+			char *val = strchr(key, ' ');
+
+			if (!val) {
+				ret = -EINVAL;
+				break;
+			}
+			*val++ = '\0';
+			ret = bench_results_meta(res, key, "%s", val);
+		} else if (!strncmp(line, "metric ", 7)) {
+			ret = bench_results_parse_metric(res, line + 7);
+		} else if (line[0]) {
+			ret = -EINVAL;
+		}
+	}
+out:
+	fclose(f);
+	return ret;
+}
+
+void bench_metric_stats(const struct bench_metric *m, double *mean,
+			double *sd)
+{
+	double sum = 0, sq = 0;
+	unsigned int i;
+
+	for (i = 0; i < m->nr; i++)
+		sum += m->val[i];
+	*mean = m->nr ? sum / m->nr : 0;
+	for (i = 0; i < m->nr; i++)
+		sq += (m->val[i] - *mean) * (m->val[i] - *mean);
+	*sd = (1 < m->nr) ? sqrt(sq / (m->nr - 1)) : 0;
+}
+
+/* two-sided 97.5% quantile of Student's t distribution */
+static double bench_t975(double df)
+{
+	static const double t[] = {
+		0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+		2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110,
+		2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056,
+		2.052, 2.048, 2.045, 2.042,
+	};
+	unsigned int i = (unsigned int)df;
+
+	if (1 > i)
+		i = 1;
+	if (i < sizeof(t) / sizeof(t[0]))
+		return t[i];
+	if (60 > i)
+		return 2.00;
+	if (120 > i)
+		return 1.98;
+	return 1.96;
+}
+
+static const struct bench_metric *
+bench_results_find(const struct bench_results *res, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < res->nr_metrics; i++) {
+		if (!strcmp(res->metric[i].name, name))
+			return &res->metric[i];
+	}
+	return NULL;
+}
+
+static double Threshold = 1.0;
+
+static void usage(void)
+{
+	fprintf(stderr, "\nCompare two result sets of jent-bench\n\n");
+	fprintf(stderr, "Usage: jent-bench compare [options] <baseline> <candidate>\n");
+	fprintf(stderr, "\t-t\tIgnore changes below this many percent (default 1)\n");
+	fprintf(stderr, "Exits with 2 if a metric regressed significantly\n");
+	exit(1);
+}
+
+int bench_compare(int argc, char *argv[])
+{
+	static struct bench_results base, cand;
+	static const char *keys[] = { "mode", "label", "host", "cpu", "cpus",
+				      "kernel", "config", "digest", "date" };
+	unsigned int i, regressions = 0, improvements = 0;
+	int c, ret;
+
+	while (-1 != (c = getopt(argc, argv, "t:"))) {
+		switch (c) {
+		case 't':
+			Threshold = strtod(optarg, NULL);
+			if (0 > Threshold)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind + 2 != argc)
+		usage();
+
+	ret = bench_results_read(&base, argv[optind]);
+	if (!ret)
+		ret = bench_results_read(&cand, argv[optind + 1]);
+	if (ret) {
+		fprintf(stderr, "Cannot read result set: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		const char *a = bench_results_get_meta(&base, keys[i]);
+		const char *b = bench_results_get_meta(&cand, keys[i]);
+
+		if (!a && !b)
+			continue;
+		if (a && b && !strcmp(a, b))
+			printf("%-8s %s\n", keys[i], a);
+		else
+			printf("%-8s %s -> %s\n", keys[i], a ? a : "-",
+			       b ? b : "-");
+	}
+	printf("\n%-34s %14s %14s %8s %9s  %s\n", "metric", "baseline",
+	       "candidate", "change", "+/-95%", "verdict");
+
+	for (i = 0; i < base.nr_metrics; i++) {
+		const struct bench_metric *a = &base.metric[i];
+		const struct bench_metric *b = bench_results_find(&cand, a->name);
+		double ma, sa, mb, sb, va, vb, se, df, ci, change;
+		const char *verdict;
+
+		if (!b)
+			continue;
+		bench_metric_stats(a, &ma, &sa);
+		bench_metric_stats(b, &mb, &sb);
+		change = ma ? 100.0 * (mb - ma) / fabs(ma) : 0;
+
+		/* Welch's t-test with the Welch-Satterthwaite degrees */
+		va = (1 < a->nr) ? sa * sa / a->nr : 0;
+		vb = (1 < b->nr) ? sb * sb / b->nr : 0;
+		se = sqrt(va + vb);
+		if (va + vb > 0) {
+			df = (va + vb) * (va + vb);
+			df /= (1 < a->nr ? va * va / (a->nr - 1) : 0) +
+			      (1 < b->nr ? vb * vb / (b->nr - 1) : 0);
+		} else {
+			df = a->nr + b->nr - 2;
+		}
+		ci = bench_t975(df) * se;
+
+		if (2 > a->nr || 2 > b->nr) {
+			verdict = "too few runs";
+		} else if (fabs(mb - ma) <= ci ||
+			   fabs(change) < Threshold) {
+			verdict = "no change";
+		} else if ((mb > ma) == (a->higher_better != 0)) {
+			verdict = "improved";
+			improvements++;
+		} else {
+			verdict = "REGRESSED";
+			regressions++;
+		}
+		printf("%-34s %14.6g %14.6g %+7.2f%% %8.2f%%  %s\n", a->name,
+		       ma, mb, change, ma ? 100.0 * ci / fabs(ma) : 0,
+		       verdict);
+	}
+	printf("\n%u improved, %u regressed\n", improvements, regressions);
+
+	return regressions ? 2 : 0;
+}
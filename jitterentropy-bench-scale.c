@@ -0,0 +1,405 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Multi-thread scalability mode of jent-bench
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * One entropy collector per CPU should scale linearly, but the collectors
+ * share caches, memory bandwidth and possibly a timer source that traps
+ * into the hypervisor. The scale mode runs 1..N entropy collectors at the
+ * same time, each in its own thread, and reports the aggregate throughput,
+ * the parallel efficiency relative to a single entropy collector of the
+ * same configuration and the Von-Neuman rejection rate of every thread.
+ *
+ * The threads are placed by one of the pinning strategies:
+ *
+ *	compact	fill all SMT siblings of a core before the next core
+ *	spread	one CPU of every core first, then the second siblings
+ *	nosmt	only the first SMT sibling of every core
+ *	none	no pinning, the scheduler decides
+ *
+ * The memory region of the memory access noise source is varied with
+ * JENT_MEMORY_SHIFT.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "jitterentropy-bench.h"
+#include "jitterentropy-topology.h"
+
+enum scale_pin {
+	SCALE_PIN_COMPACT,
+	SCALE_PIN_SPREAD,
+	SCALE_PIN_NOSMT,
+	SCALE_PIN_NONE,
+	SCALE_PIN_MAX,
+};
+
+static const char *Pin_names[SCALE_PIN_MAX] = {
+	"compact", "spread", "nosmt", "none"
+};
+
+#define MAX_SHIFTS 16
+
+static double Seconds = 2;
+static unsigned int Osr = 1;
+static unsigned int Max_threads;
+static int Pin = -1;		/* all strategies */
+static unsigned int Shifts[MAX_SHIFTS];
+static unsigned int Nr_shifts;
+static unsigned int Runs = 1;
+static const char *Label;
+static const char *Results_file;
+static struct bench_results Results;
+
+struct scale_thread {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	int cpu;
+	unsigned int flags;
+	int ret;
+	struct bench_sample sample;
+};
+
+static void *scale_worker(void *arg)
+{
+	struct scale_thread *self = arg;
+	struct rand_data *ec;
+
+	bench_pin(self->cpu);
+	ec = jent_entropy_collector_alloc(Osr, self->flags);
+	/* everybody waits at the barrier, even after a failure */
+	pthread_barrier_wait(self->barrier);
+	if (!ec) {
+		self->ret = -ENOMEM;
+		return NULL;
+	}
+	self->ret = bench_measure(ec, Seconds, 0, &self->sample);
+	jent_entropy_collector_free(ec);
+	return NULL;
+}
+
+/*
+ * CPU order of a pinning strategy.
+ *
+ * return: number of usable CPUs for the strategy
+ */
+static unsigned int scale_order(const struct jent_topology *topo,
+				enum scale_pin pin, int *cpus)
+{
+	unsigned int i, j, n = 0;
+
+	switch (pin) {
+	case SCALE_PIN_COMPACT:
+		/* cores in the order they are first seen, siblings grouped */
+		for (i = 0; i < topo->nr_cpus; i++) {
+			for (j = 0; j < i; j++) {
+				if (topo->core[j] == topo->core[i])
+					break;
+			}
+			if (j < i)
+				continue;
+			for (j = i; j < topo->nr_cpus; j++) {
+				if (topo->core[j] == topo->core[i])
+					cpus[n++] = topo->cpu[j];
+			}
+		}
+		return n;
+	case SCALE_PIN_SPREAD:
+		jent_topology_spread(topo, topo->nr_cpus, cpus);
+		return topo->nr_cpus;
+	case SCALE_PIN_NOSMT:
+		/* the first usable sibling of every core */
+		for (i = 0; i < topo->nr_cpus; i++) {
+			for (j = 0; j < i; j++) {
+				if (topo->core[j] == topo->core[i])
+					break;
+			}
+			if (j == i)
+				cpus[n++] = topo->cpu[i];
+		}
+		return n;
+	default:
+		for (i = 0; i < topo->nr_cpus; i++)
+			cpus[i] = -1;
+		return topo->nr_cpus;
+	}
+}
+
+/* run @n entropy collectors at the same time */
+static int scale_point(const int *cpus, unsigned int n, unsigned int flags,
+		       struct scale_thread *threads)
+{
+	pthread_barrier_t barrier;
+	unsigned int i, started;
+	int ret = 0;
+
+	if (pthread_barrier_init(&barrier, NULL, n))
+		return -ENOMEM;
+	for (started = 0; started < n; started++) {
+		struct scale_thread *t = &threads[started];
+
+		memset(t, 0, sizeof(*t));
+		t->barrier = &barrier;
+		t->cpu = cpus[started];
+		t->flags = flags;
+		if (pthread_create(&t->thread, NULL, scale_worker, t)) {
+			ret = -EAGAIN;
+			break;
+		}
+	}
+	if (ret) {
+		/* the barrier can never be passed, give up */
+		fprintf(stderr, "Cannot start %u threads\n", n);
+		exit(1);
+	}
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i].thread, NULL);
+		if (threads[i].ret && !ret)
+			ret = threads[i].ret;
+	}
+	pthread_barrier_destroy(&barrier);
+	return ret;
+}
+
+static int scale_curve(const struct jent_topology *topo, enum scale_pin pin,
+		       unsigned int shift, struct scale_thread *threads,
+		       int *cpus)
+{
+	unsigned int usable = scale_order(topo, pin, cpus);
+	unsigned int n, i, run, max = Max_threads;
+	double single = 0;
+	char name[64];
+	int ret = 0;
+
+	if (SCALE_PIN_NONE != pin && max > usable)
+		max = usable;
+
+	printf("\n%s pinning, memory %u bytes\n", Pin_names[pin],
+	       (unsigned int)(JENT_MEMORY_SIZE << shift));
+	printf("%7s %12s %10s %10s  %s\n", "threads", "bytes/s", "efficiency",
+	       "rejected", "rejected per thread");
+	for (n = 1; !ret && n <= max; n++) {
+		for (run = 0; !ret && run < Runs; run++) {
+			double total = 0, reject = 0, eff;
+
+			ret = scale_point(cpus, n, JENT_MEMORY_SHIFT(shift),
+					  threads);
+			if (ret)
+				break;
+			for (i = 0; i < n; i++) {
+				total += threads[i].sample.bytes_per_sec;
+				reject += threads[i].sample.reject_rate;
+			}
+			reject /= n;
+			if (1 == n && !run)
+				single = total;
+			eff = single ? total / (n * single) : 0;
+
+			printf("%7u %12.0f %9.1f%% %9.2f%% ", n, total,
+			       100.0 * eff, 100.0 * reject);
+			for (i = 0; i < n; i++)
+				printf(" %.1f",
+				       100.0 * threads[i].sample.reject_rate);
+			printf("\n");
+
+			snprintf(name, sizeof(name), "scale.%s.m%u.t%u.throughput",
+				 Pin_names[pin], shift, n);
+			ret = bench_results_add(&Results, name, "bytes/s", 1,
+						total);
+			snprintf(name, sizeof(name), "scale.%s.m%u.t%u.efficiency",
+				 Pin_names[pin], shift, n);
+			ret = ret ? ret : bench_results_add(&Results, name,
+							    "ratio", 1, eff);
+			snprintf(name, sizeof(name), "scale.%s.m%u.t%u.rejected",
+				 Pin_names[pin], shift, n);
+			ret = ret ? ret : bench_results_add(&Results, name,
+							    "ratio", 0, reject);
+		}
+	}
+	if (ret)
+		fprintf(stderr, "Measurement failed: %s\n", strerror(-ret));
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "\nMulti-thread scalability benchmark of the CPU Jitter RNG\n\n");
+	fprintf(stderr, "Usage: jent-bench scale [options]\n");
+	fprintf(stderr, "\t-N\tMaximum number of threads (default: number of CPUs)\n");
+	fprintf(stderr, "\t-P\tPinning compact, spread, nosmt or none (default: all\n");
+	fprintf(stderr, "\t\tbut none)\n");
+	fprintf(stderr, "\t-M\tMemory region of JENT_MEMORY_SIZE << shift bytes, may\n");
+	fprintf(stderr, "\t\tbe given up to %d times (default 0)\n", MAX_SHIFTS);
+	fprintf(stderr, "\t-s\tSeconds per measurement (default 2)\n");
+	fprintf(stderr, "\t-o\tOversampling rate of the entropy collectors\n");
+	fprintf(stderr, "\t-R\tRepeated runs per measurement (default 1)\n");
+	fprintf(stderr, "\t-w\tWrite the results to this file\n");
+	fprintf(stderr, "\t-L\tLabel stored with the results, e.g. the library version\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"threads", 1, 0, 'N'},
+			{"pin", 1, 0, 'P'},
+			{"memshift", 1, 0, 'M'},
+			{"seconds", 1, 0, 's'},
+			{"osr", 1, 0, 'o'},
+			{"runs", 1, 0, 'R'},
+			{"write", 1, 0, 'w'},
+			{"label", 1, 0, 'L'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "N:P:M:s:o:R:w:L:", opts,
+				&opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'N':
+			Max_threads = strtoul(optarg, NULL, 10);
+			if (!Max_threads)
+				usage();
+			break;
+		case 'P':
+			for (Pin = 0; Pin < SCALE_PIN_MAX; Pin++) {
+				if (!strcmp(optarg, Pin_names[Pin]))
+					break;
+			}
+			if (SCALE_PIN_MAX == Pin)
+				usage();
+			break;
+		case 'M': {
+			unsigned long shift = strtoul(optarg, NULL, 10);
+
+			if (MAX_SHIFTS <= Nr_shifts || 15 < shift)
+				usage();
+			Shifts[Nr_shifts++] = shift;
+			break;
+		}
+		case 's':
+			Seconds = strtod(optarg, NULL);
+			if (0 >= Seconds)
+				usage();
+			break;
+		case 'o':
+			Osr = strtoul(optarg, NULL, 10);
+			break;
+		case 'R':
+			Runs = strtoul(optarg, NULL, 10);
+			if (!Runs || BENCH_MAX_RUNS < Runs)
+				usage();
+			break;
+		case 'w':
+			Results_file = optarg;
+			break;
+		case 'L':
+			Label = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+}
+
+int bench_scale(int argc, char *argv[])
+{
+	struct jent_topology topo;
+	struct scale_thread *threads = NULL;
+	int *cpus = NULL;
+	unsigned int i, size;
+	int pin, ret;
+
+	parse_opts(argc, argv);
+	if (!Nr_shifts)
+		Shifts[Nr_shifts++] = 0;
+
+	ret = jent_topology_read(&topo);
+	if (ret) {
+		fprintf(stderr, "Cannot read the CPU topology: %d\n", ret);
+		return ret;
+	}
+	if (!Max_threads)
+		Max_threads = topo.nr_cpus;
+	size = (Max_threads > topo.nr_cpus) ? Max_threads : topo.nr_cpus;
+	threads = calloc(size, sizeof(*threads));
+	cpus = calloc(size, sizeof(int));
+	if (!threads || !cpus) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	/* unpinned threads beyond the CPU count */
+	for (i = 0; i < size; i++)
+		cpus[i] = -1;
+
+	bench_results_init(&Results, "scale", Label);
+	bench_results_meta(&Results, "config", "osr=%u seconds=%g threads=%u",
+			   Osr, Seconds, Max_threads);
+	printf("%u CPUs, up to %u threads\n", topo.nr_cpus, Max_threads);
+	for (i = 0; !ret && i < Nr_shifts; i++) {
+		for (pin = 0; !ret && pin < SCALE_PIN_MAX; pin++) {
+			if ((0 > Pin && SCALE_PIN_NONE == pin) ||
+			    (0 <= Pin && pin != Pin))
+				continue;
+			ret = scale_curve(&topo, pin, Shifts[i], threads, cpus);
+		}
+	}
+	if (!ret && Results_file) {
+		ret = bench_results_write(&Results, Results_file);
+		if (ret)
+			fprintf(stderr, "Cannot write %s: %s\n", Results_file,
+				strerror(-ret));
+	}
+
+out:
+	free(threads);
+	free(cpus);
+	jent_topology_free(&topo);
+	return ret;
+}
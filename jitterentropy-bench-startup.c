@@ -0,0 +1,388 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Startup and footprint mode of jent-bench
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Short-lived programs pay for the start of the CPU Jitter RNG on every
+ * invocation. The startup mode measures
+ *
+ *	- jent_entropy_init on its first call in the process and repeated via
+ *	  jent_entropy_revalidate,
+ *	- the latency of jent_entropy_collector_alloc, which generates one
+ *	  64 bit word to prime the entropy collector,
+ *	- the time from the start of the allocation to the first output byte
+ *	  and
+ *	- the resident memory and pages per entropy collector after every
+ *	  entropy collector produced its first output; jent_zalloc clears
+ *	  the memory of the memory access noise source, so it is fully
+ *	  resident right after the allocation
+ *
+ * for a number of memory region sizes and entropy collector counts. Every
+ * configuration is measured in a forked child so that memory released by
+ * one configuration does not hide the footprint of the next one.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include "jitterentropy-bench.h"
+
+#define MAX_LIST 16
+
+static unsigned int Shifts[MAX_LIST];
+static unsigned int Nr_shifts;
+static unsigned int Counts[MAX_LIST];
+static unsigned int Nr_counts;
+static unsigned int Runs = 5;
+static const char *Label;
+static const char *Results_file;
+static struct bench_results Results;
+
+/* measurement of one configuration, passed from the child */
+struct startup_result {
+	int ret;
+	double alloc_mean;	/* ns */
+	double alloc_max;	/* ns */
+	double first_byte;	/* ns from the allocation to the first byte */
+	double rss;		/* bytes per entropy collector */
+	double pages;		/* resident pages per entropy collector */
+};
+
+static long startup_resident(void)
+{
+	long size = 0, resident = -1;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (!f)
+		return -1;
+	if (2 != fscanf(f, "%ld %ld", &size, &resident))
+		resident = -1;
+	fclose(f);
+	return resident;
+}
+
+static void startup_measure(unsigned int flags, unsigned int count,
+			    struct startup_result *res)
+{
+	struct rand_data **ec = calloc(count, sizeof(*ec));
+	struct rand_data *warm;
+	long before, after;
+	unsigned int i;
+	char byte;
+
+	memset(res, 0, sizeof(*res));
+	if (!ec) {
+		res->ret = -ENOMEM;
+		return;
+	}
+	/* fault in the code and the heap arena with an entropy collector
+	 * that is kept so that its memory is not reused */
+	warm = jent_entropy_collector_alloc(1, flags);
+	if (!warm || 0 > jent_read_entropy(warm, &byte, 1)) {
+		res->ret = -ENOMEM;
+		goto out;
+	}
+	/* the first reads of the statistics and the clock allocate, too */
+	startup_resident();
+	bench_ns(CLOCK_MONOTONIC);
+	before = startup_resident();
+	for (i = 0; i < count; i++) {
+		__u64 start = bench_ns(CLOCK_MONOTONIC), alloc;
+
+		ec[i] = jent_entropy_collector_alloc(1, flags);
+		alloc = bench_ns(CLOCK_MONOTONIC);
+		if (!ec[i] || 0 > jent_read_entropy(ec[i], &byte, 1)) {
+			res->ret = -ENOMEM;
+			break;
+		}
+		res->alloc_mean += alloc - start;
+		if (alloc - start > res->alloc_max)
+			res->alloc_max = alloc - start;
+		res->first_byte += bench_ns(CLOCK_MONOTONIC) - start;
+	}
+	after = startup_resident();
+	if (!res->ret) {
+		long pagesize = sysconf(_SC_PAGESIZE);
+
+		res->alloc_mean /= count;
+		res->first_byte /= count;
+		if (0 <= before && 0 <= after) {
+			res->pages = (double)(after - before) / count;
+			res->rss = res->pages * pagesize;
+		}
+	}
+	for (i = 0; i < count; i++) {
+		if (ec[i])
+			jent_entropy_collector_free(ec[i]);
+	}
+out:
+	if (warm)
+		jent_entropy_collector_free(warm);
+	free(ec);
+}
+
+/* measure in a child with a clean heap */
+static int startup_config(unsigned int flags, unsigned int count,
+			  struct startup_result *res)
+{
+	int fds[2], status;
+	pid_t pid;
+
+	if (pipe(fds))
+		return -errno;
+	pid = fork();
+	if (0 > pid) {
+		close(fds[0]);
+		close(fds[1]);
+		return -errno;
+	}
+	if (!pid) {
+		close(fds[0]);
+		startup_measure(flags, count, res);
+		if (sizeof(*res) != write(fds[1], res, sizeof(*res)))
+			_exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	if (sizeof(*res) != read(fds[0], res, sizeof(*res)))
+		res->ret = -EIO;
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+	return res->ret;
+}
+
+static int startup_record(const char *config, unsigned int count,
+			  const char *quantity, const char *unit, double val)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "startup.%s.n%u.%s", config, count,
+		 quantity);
+	return bench_results_add(&Results, name, unit, 0, val);
+}
+
+static int startup_table(void)
+{
+	unsigned int i, j, run;
+	int ret = 0;
+
+	printf("\n%-10s %10s %10s %10s %10s %12s %8s\n", "memory", "collectors",
+	       "alloc us", "max us", "first us", "RSS bytes", "pages");
+	/* Shifts[Nr_shifts] is the configuration without memory access */
+	for (i = 0; !ret && i <= Nr_shifts; i++) {
+		unsigned int flags = (i < Nr_shifts) ?
+			JENT_MEMORY_SHIFT(Shifts[i]) :
+			JENT_DISABLE_MEMORY_ACCESS;
+		char config[16];
+
+		if (i < Nr_shifts)
+			snprintf(config, sizeof(config), "%u",
+				 (unsigned int)(JENT_MEMORY_SIZE << Shifts[i]));
+		else
+			snprintf(config, sizeof(config), "none");
+
+		for (j = 0; !ret && j < Nr_counts; j++) {
+			struct startup_result sum, res;
+
+			memset(&sum, 0, sizeof(sum));
+			for (run = 0; !ret && run < Runs; run++) {
+				ret = startup_config(flags, Counts[j], &res);
+				if (ret)
+					break;
+				sum.alloc_mean += res.alloc_mean / Runs;
+				if (res.alloc_max > sum.alloc_max)
+					sum.alloc_max = res.alloc_max;
+				sum.first_byte += res.first_byte / Runs;
+				sum.rss += res.rss / Runs;
+				sum.pages += res.pages / Runs;
+
+				ret = startup_record(config, Counts[j], "alloc",
+						     "ns", res.alloc_mean);
+				ret = ret ? ret :
+				      startup_record(config, Counts[j],
+						     "first_byte", "ns",
+						     res.first_byte);
+				ret = ret ? ret :
+				      startup_record(config, Counts[j], "rss",
+						     "bytes", res.rss);
+			}
+			if (ret)
+				break;
+			printf("%-10s %10u %10.1f %10.1f %10.1f %12.0f %8.1f\n",
+			       config, Counts[j], sum.alloc_mean / 1000,
+			       sum.alloc_max / 1000, sum.first_byte / 1000,
+			       sum.rss, sum.pages);
+		}
+	}
+	if (ret)
+		fprintf(stderr, "Measurement failed: %s\n", strerror(-ret));
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "\nStartup and footprint benchmark of the CPU Jitter RNG\n\n");
+	fprintf(stderr, "Usage: jent-bench startup [options]\n");
+	fprintf(stderr, "\t-M\tMemory region of JENT_MEMORY_SIZE << shift bytes, may\n");
+	fprintf(stderr, "\t\tbe given up to %d times (default 0, 4 and 8)\n",
+		MAX_LIST);
+	fprintf(stderr, "\t-n\tNumber of entropy collectors, may be given up to %d\n",
+		MAX_LIST);
+	fprintf(stderr, "\t\ttimes (default 1, 8 and 64)\n");
+	fprintf(stderr, "\t-R\tRepeated runs (default 5)\n");
+	fprintf(stderr, "\t-w\tWrite the results to this file\n");
+	fprintf(stderr, "\t-L\tLabel stored with the results, e.g. the library version\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"memshift", 1, 0, 'M'},
+			{"collectors", 1, 0, 'n'},
+			{"runs", 1, 0, 'R'},
+			{"write", 1, 0, 'w'},
+			{"label", 1, 0, 'L'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "M:n:R:w:L:", opts, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'M': {
+			unsigned long shift = strtoul(optarg, NULL, 10);
+
+			if (MAX_LIST <= Nr_shifts || 15 < shift)
+				usage();
+			Shifts[Nr_shifts++] = shift;
+			break;
+		}
+		case 'n': {
+			unsigned long count = strtoul(optarg, NULL, 10);
+
+			if (MAX_LIST <= Nr_counts || !count)
+				usage();
+			Counts[Nr_counts++] = count;
+			break;
+		}
+		case 'R':
+			Runs = strtoul(optarg, NULL, 10);
+			if (!Runs || BENCH_MAX_RUNS < Runs)
+				usage();
+			break;
+		case 'w':
+			Results_file = optarg;
+			break;
+		case 'L':
+			Label = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+}
+
+int bench_startup(int argc, char *argv[])
+{
+	struct jent_init_diag diag;
+	__u64 start, cold, warm = 0;
+	unsigned int run;
+	int ret;
+
+	parse_opts(argc, argv);
+	if (!Nr_shifts) {
+		Shifts[Nr_shifts++] = 0;
+		Shifts[Nr_shifts++] = 4;
+		Shifts[Nr_shifts++] = 8;
+	}
+	if (!Nr_counts) {
+		Counts[Nr_counts++] = 1;
+		Counts[Nr_counts++] = 8;
+		Counts[Nr_counts++] = 64;
+	}
+	bench_results_init(&Results, "startup", Label);
+
+	/* the dispatcher left the initialization to this mode */
+	start = bench_ns(CLOCK_MONOTONIC);
+	ret = jent_entropy_init();
+	cold = bench_ns(CLOCK_MONOTONIC) - start;
+	if (ret) {
+		fprintf(stderr, "The initialization of CPU Jitter RNG failed with error code %d\n", ret);
+		return -EFAULT;
+	}
+	bench_results_add(&Results, "startup.init.cold", "ns", 0, cold);
+	for (run = 0; run < Runs; run++) {
+		__u64 time;
+
+		start = bench_ns(CLOCK_MONOTONIC);
+		ret = jent_entropy_revalidate();
+		time = bench_ns(CLOCK_MONOTONIC) - start;
+		/* the time of a failed test run is not a startup cost */
+		if (ret) {
+			fprintf(stderr, "The repeated initialization of CPU Jitter RNG failed with error code %d\n", ret);
+			return -EFAULT;
+		}
+		warm += time;
+		bench_results_add(&Results, "startup.init.repeat", "ns", 0,
+				  time);
+	}
+	jent_entropy_init_diag(&diag);
+
+	printf("jent_entropy_init:\t%.2f ms first call, %.2f ms repeated, %u test loops\n",
+	       cold / 1e6, warm / 1e6 / Runs, diag.loops);
+	printf("struct rand_data:\t%zu bytes\n", sizeof(struct rand_data));
+	bench_results_meta(&Results, "config", "runs=%u", Runs);
+
+	ret = startup_table();
+	if (!ret && Results_file) {
+		ret = bench_results_write(&Results, Results_file);
+		if (ret)
+			fprintf(stderr, "Cannot write %s: %s\n", Results_file,
+				strerror(-ret));
+	}
+	return ret;
+}
@@ -0,0 +1,412 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Noisy-neighbor stress mode of jent-bench
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * The entropy collector measures the execution time of its own memory
+ * accesses, so whatever else runs on the CPU, the shared caches or the
+ * memory bus changes the distribution of the time deltas. The stress mode
+ * pins one entropy collector to a CPU and measures it while interferer
+ * threads generate one kind of load each:
+ *
+ *	spin	busy loops on the SMT siblings and the other CPUs
+ *	stream	memcpy over buffers larger than the last level cache
+ *	thrash	dependent random reads over a large buffer
+ *	timer	short sleeps on the collector CPU, i.e. a timer interrupt
+ *		and context switch storm
+ *
+ * On a single CPU the spin, stream and thrash interferers share the CPU with
+ * the entropy collector and merely compete for time slices.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "jitterentropy-bench.h"
+#include "jitterentropy-topology.h"
+
+#define STREAM_SIZE (64UL << 20)
+#define THRASH_SIZE (32UL << 20)
+#define TIMER_SLEEP_NS 10000
+
+static volatile int Running;
+
+struct interferer {
+	pthread_t thread;
+	int cpu;
+	unsigned int seed;
+};
+
+static void *stress_spin(void *arg)
+{
+	struct interferer *self = arg;
+	volatile __u64 x = 0;
+
+	bench_pin(self->cpu);
+	while (Running)
+		x++;
+	return NULL;
+}
+
+static void *stress_stream(void *arg)
+{
+	struct interferer *self = arg;
+	size_t half = STREAM_SIZE / 2;
+	char *buf = malloc(STREAM_SIZE);
+
+	bench_pin(self->cpu);
+	if (!buf)
+		return NULL;
+	memset(buf, 1, STREAM_SIZE);
+	while (Running) {
+		memcpy(buf + half, buf, half);
+		memcpy(buf, buf + half, half);
+	}
+	free(buf);
+	return NULL;
+}
+
+static void *stress_thrash(void *arg)
+{
+	struct interferer *self = arg;
+	size_t nr = THRASH_SIZE / sizeof(size_t), i, j;
+	size_t *buf = malloc(THRASH_SIZE);
+
+	bench_pin(self->cpu);
+	if (!buf)
+		return NULL;
+	/* one random cycle through the buffer defeats the prefetcher */
+	for (i = 0; i < nr; i++)
+		buf[i] = i;
+	for (i = nr - 1; i > 0; i--) {
+		size_t tmp;
+
+		j = rand_r(&self->seed) % i;
+		tmp = buf[i];
+		buf[i] = buf[j];
+		buf[j] = tmp;
+	}
+	i = 0;
+	while (Running) {
+		for (j = 0; j < 4096; j++)
+			i = buf[i];
+	}
+	free(buf);
+	return NULL;
+}
+
+static void *stress_timer(void *arg)
+{
+	struct interferer *self = arg;
+	struct timespec ts = { 0, TIMER_SLEEP_NS };
+
+	bench_pin(self->cpu);
+	while (Running)
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+	return NULL;
+}
+
+static const struct {
+	const char *name;
+	void *(*run)(void *arg);
+	int local;		/* interferers run on the collector CPU */
+} Scenarios[] = {
+	{ "idle", NULL, 0 },
+	{ "spin", stress_spin, 0 },
+	{ "stream", stress_stream, 0 },
+	{ "thrash", stress_thrash, 0 },
+	{ "timer", stress_timer, 1 },
+};
+#define NR_SCENARIOS (sizeof(Scenarios) / sizeof(Scenarios[0]))
+
+static double Seconds = 3;
+static size_t Raw_samples = BENCH_SAMPLES;
+static unsigned int Osr = 1;
+static unsigned int Nr_threads;
+static const char *Only;
+static unsigned int Runs = 1;
+static const char *Label;
+static const char *Results_file;
+static struct bench_results Results;
+
+/*
+ * Order the CPUs for the interferers: the SMT siblings of the collector CPU
+ * first, then all other CPUs. Returns the number of CPUs other than the
+ * collector CPU.
+ */
+static unsigned int stress_neighbors(const struct jent_topology *topo,
+				     int *cpus)
+{
+	int core = topo->core[0];
+	unsigned int i, n = 0;
+
+	for (i = 1; i < topo->nr_cpus; i++) {
+		if (topo->core[i] == core)
+			cpus[n++] = topo->cpu[i];
+	}
+	for (i = 1; i < topo->nr_cpus; i++) {
+		if (topo->core[i] != core)
+			cpus[n++] = topo->cpu[i];
+	}
+	return n;
+}
+
+static int stress_record(const char *scenario,
+			 const struct bench_sample *sample)
+{
+	char name[64];
+	int ret;
+
+	snprintf(name, sizeof(name), "stress.%s.throughput", scenario);
+	ret = bench_results_add(&Results, name, "bytes/s", 1,
+				sample->bytes_per_sec);
+	snprintf(name, sizeof(name), "stress.%s.rejected", scenario);
+	ret = ret ? ret : bench_results_add(&Results, name, "ratio", 0,
+					    sample->reject_rate);
+	if (!Raw_samples)
+		return ret;
+	snprintf(name, sizeof(name), "stress.%s.min_entropy", scenario);
+	return ret ? ret : bench_results_add(&Results, name, "bits", 1,
+					     sample->min_entropy);
+}
+
+static int stress_run(struct rand_data *ec, unsigned int scenario,
+		      const struct jent_topology *topo, const int *neighbors,
+		      unsigned int nr_neighbors)
+{
+	struct interferer *threads = NULL;
+	struct bench_sample sample;
+	unsigned int i, nr = 0;
+	int ret;
+
+	if (Scenarios[scenario].run) {
+		threads = calloc(Nr_threads, sizeof(*threads));
+		if (!threads)
+			return -ENOMEM;
+		Running = 1;
+		for (nr = 0; nr < Nr_threads; nr++) {
+			struct interferer *t = &threads[nr];
+
+			if (Scenarios[scenario].local || !nr_neighbors)
+				t->cpu = topo->cpu[0];
+			else
+				t->cpu = neighbors[nr % nr_neighbors];
+			t->seed = nr + 1;
+			if (pthread_create(&t->thread, NULL,
+					   Scenarios[scenario].run, t))
+				break;
+		}
+		/* let the streamers and thrashers set up their buffers */
+		usleep(200000);
+	}
+
+	ret = bench_measure(ec, Seconds, Raw_samples, &sample);
+
+	Running = 0;
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i].thread, NULL);
+	free(threads);
+
+	if (ret) {
+		printf("%-8s measurement failed: %d\n",
+		       Scenarios[scenario].name, ret);
+		return ret;
+	}
+	printf("%-8s %8u %12.0f %9.2f%% %10llu %10.3f\n",
+	       Scenarios[scenario].name, nr, sample.bytes_per_sec,
+	       100.0 * sample.reject_rate,
+	       (unsigned long long)sample.fallbacks, sample.min_entropy);
+	return stress_record(Scenarios[scenario].name, &sample);
+}
+
+static void usage(void)
+{
+	unsigned int i;
+
+	fprintf(stderr, "\nNoisy-neighbor stress benchmark of the CPU Jitter RNG\n\n");
+	fprintf(stderr, "Usage: jent-bench stress [options]\n");
+	fprintf(stderr, "\t-s\tSeconds of output generated per scenario (default 3)\n");
+	fprintf(stderr, "\t-n\tRaw time deltas for the min-entropy estimate\n");
+	fprintf(stderr, "\t\t(default %d, 0 disables the estimate)\n",
+		BENCH_SAMPLES);
+	fprintf(stderr, "\t-j\tInterferer threads (default: number of CPUs - 1)\n");
+	fprintf(stderr, "\t-o\tOversampling rate of the entropy collector\n");
+	fprintf(stderr, "\t-R\tRepeated runs per scenario (default 1, at most %d)\n",
+		BENCH_MAX_RUNS);
+	fprintf(stderr, "\t-w\tWrite the results to this file\n");
+	fprintf(stderr, "\t-L\tLabel stored with the results, e.g. the library version\n");
+	fprintf(stderr, "\t-S\tRun only the named scenario:");
+	for (i = 0; i < NR_SCENARIOS; i++)
+		fprintf(stderr, " %s", Scenarios[i].name);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"seconds", 1, 0, 's'},
+			{"samples", 1, 0, 'n'},
+			{"threads", 1, 0, 'j'},
+			{"osr", 1, 0, 'o'},
+			{"scenario", 1, 0, 'S'},
+			{"runs", 1, 0, 'R'},
+			{"write", 1, 0, 'w'},
+			{"label", 1, 0, 'L'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "s:n:j:o:S:R:w:L:", opts,
+				&opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 's':
+			Seconds = strtod(optarg, NULL);
+			if (0 >= Seconds)
+				usage();
+			break;
+		case 'n':
+			Raw_samples = strtoul(optarg, NULL, 10);
+			break;
+		case 'j':
+			Nr_threads = strtoul(optarg, NULL, 10);
+			if (!Nr_threads)
+				usage();
+			break;
+		case 'o':
+			Osr = strtoul(optarg, NULL, 10);
+			break;
+		case 'S':
+			Only = optarg;
+			break;
+		case 'R':
+			Runs = strtoul(optarg, NULL, 10);
+			if (!Runs || BENCH_MAX_RUNS < Runs)
+				usage();
+			break;
+		case 'w':
+			Results_file = optarg;
+			break;
+		case 'L':
+			Label = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+}
+
+int bench_stress(int argc, char *argv[])
+{
+	struct jent_topology topo;
+	struct rand_data *ec = NULL;
+	int *neighbors = NULL;
+	unsigned int i, run, nr_neighbors;
+	int ret;
+
+	parse_opts(argc, argv);
+	for (i = 0; Only && i < NR_SCENARIOS; i++) {
+		if (!strcmp(Only, Scenarios[i].name))
+			break;
+	}
+	if (NR_SCENARIOS == i)
+		usage();
+
+	ret = jent_topology_read(&topo);
+	if (ret) {
+		fprintf(stderr, "Cannot read the CPU topology: %d\n", ret);
+		return ret;
+	}
+	neighbors = calloc(topo.nr_cpus, sizeof(int));
+	if (!neighbors) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	nr_neighbors = stress_neighbors(&topo, neighbors);
+	if (!Nr_threads)
+		Nr_threads = nr_neighbors ? nr_neighbors : 1;
+
+	ret = bench_pin(topo.cpu[0]);
+	if (ret) {
+		fprintf(stderr, "Cannot pin to CPU %d: %d\n", topo.cpu[0], ret);
+		goto out;
+	}
+	ec = jent_entropy_collector_alloc(Osr, 0);
+	if (!ec) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	printf("Collector on CPU %d, %u other CPUs, osr %u\n", topo.cpu[0],
+	       nr_neighbors, Osr);
+	printf("%-8s %8s %12s %10s %10s %10s\n", "scenario", "threads",
+	       "bytes/s", "rejected", "fallbacks", "H_min");
+	bench_results_init(&Results, "stress", Label);
+	bench_results_meta(&Results, "config",
+			   "osr=%u seconds=%g samples=%zu threads=%u",
+			   Osr, Seconds, Raw_samples, Nr_threads);
+	for (i = 0; !ret && i < NR_SCENARIOS; i++) {
+		if (Only && strcmp(Only, Scenarios[i].name))
+			continue;
+		for (run = 0; !ret && run < Runs; run++)
+			ret = stress_run(ec, i, &topo, neighbors, nr_neighbors);
+	}
+	if (!ret && Results_file) {
+		ret = bench_results_write(&Results, Results_file);
+		if (ret)
+			fprintf(stderr, "Cannot write %s: %s\n", Results_file,
+				strerror(-ret));
+	}
+
+out:
+	if (ec)
+		jent_entropy_collector_free(ec);
+	free(neighbors);
+	jent_topology_free(&topo);
+	return ret;
+}
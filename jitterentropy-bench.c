@@ -0,0 +1,190 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Benchmark suite of the CPU Jitter RNG
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * jent-bench bundles the benchmarks of the entropy collector. Each mode
+ * lives in its own file and parses its own options; this file holds the
+ * dispatcher and the measurement shared by the modes.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "jitterentropy-bench.h"
+#include "jitterentropy-estimate.h"
+
+__u64 bench_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* pin the calling thread to @cpu, nothing happens for @cpu < 0 */
+int bench_pin(int cpu)
+{
+	cpu_set_t set;
+
+	if (0 > cpu)
+		return 0;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return -pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+ * Measure an entropy collector: generate output for @seconds, then capture
+ * @raw_samples time deltas for the min-entropy estimate.
+ *
+ * return: 0 on success, < 0 on error
+ */
+int bench_measure(struct rand_data *ec, double seconds, size_t raw_samples,
+		  struct bench_sample *sample)
+{
+	char buf[256];
+	__u64 pairs = ec->unbias_pairs;
+	__u64 discarded = ec->unbias_discarded;
+	__u64 fallbacks = jent_unbias_fallbacks(ec);
+	__u64 start = bench_ns(CLOCK_MONOTONIC), now = start;
+	__u64 end = start + (__u64)(seconds * 1e9);
+	__u64 bytes = 0;
+	__u64 *deltas = NULL;
+	__u8 *sym = NULL;
+	size_t i;
+	int ret = 0;
+
+	memset(sample, 0, sizeof(*sample));
+	do {
+		if (0 > jent_read_entropy(ec, buf, sizeof(buf)))
+			return -EFAULT;
+		bytes += sizeof(buf);
+		now = bench_ns(CLOCK_MONOTONIC);
+	} while (now < end);
+	memset(buf, 0, sizeof(buf));
+
+	sample->bytes_per_sec = bytes * 1e9 / (now - start);
+	pairs = ec->unbias_pairs - pairs;
+	discarded = ec->unbias_discarded - discarded;
+	sample->reject_rate = pairs ? (double)discarded / pairs : 0;
+	sample->fallbacks = jent_unbias_fallbacks(ec) - fallbacks;
+
+	if (!raw_samples)
+		return 0;
+	deltas = malloc(raw_samples * sizeof(__u64));
+	sym = malloc(raw_samples);
+	if (!deltas || !sym) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	/* the repetition count test may trigger on a broken timer */
+	if (0 > jent_read_raw(ec, deltas, raw_samples)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	for (i = 0; i < raw_samples; i++)
+		sym[i] = deltas[i] & 0xff;
+	sample->min_entropy = jent_est_mcv_sym(sym, raw_samples);
+
+out:
+	free(deltas);
+	free(sym);
+	return ret;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(int argc, char *argv[]);
+	int collector;		/* mode needs an entropy collector */
+	const char *help;
+} Modes[] = {
+	{ "stress", bench_stress, 1,
+	  "throughput and entropy under co-located load" },
+	{ "perf", bench_perf, 1,
+	  "hardware counter attribution per stage" },
+	{ "scale", bench_scale, 1,
+	  "throughput of 1..N concurrent entropy collectors" },
+	{ "startup", bench_startup, 0,
+	  "initialization, allocation and footprint cost" },
+	{ "afalg", bench_afalg, 0,
+	  "user space against the kernel's jitterentropy_rng" },
+	{ "compare", bench_compare, 0,
+	  "significant changes between two result sets" },
+};
+#define NR_MODES (sizeof(Modes) / sizeof(Modes[0]))
+
+static void usage(void)
+{
+	unsigned int i;
+
+	fprintf(stderr, "\nBenchmark suite of the CPU Jitter RNG\n\n");
+	fprintf(stderr, "Usage: jent-bench <mode> [options], -h after the mode lists its options\n");
+	for (i = 0; i < NR_MODES; i++)
+		fprintf(stderr, "\t%-10s%s\n", Modes[i].name, Modes[i].help);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+	int ret;
+
+	if (2 > argc)
+		usage();
+	for (i = 0; i < NR_MODES; i++) {
+		if (strcmp(argv[1], Modes[i].name))
+			continue;
+		ret = Modes[i].collector ? jent_entropy_init() : 0;
+		if (ret) {
+			fprintf(stderr, "The initialization of CPU Jitter RNG failed with error code %d\n", ret);
+			return 1;
+		}
+		/* the mode sees its name as argv[0], errors are negative and
+		 * a positive return value is passed on as exit status */
+		ret = Modes[i].run(argc - 1, argv + 1);
+		return (0 > ret) ? 1 : ret;
+	}
+	usage();
+	return 1;
+}
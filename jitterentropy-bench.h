@@ -0,0 +1,78 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Benchmark suite of the CPU Jitter RNG
+ *
+ * See jitterentropy-bench.c for the license.
+ */
+
+#ifndef _JITTERENTROPY_BENCH_H
+#define _JITTERENTROPY_BENCH_H
+
+#include <time.h>
+
+#include "jitterentropy.h"
+
+/* Measurement of one entropy collector */
+struct bench_sample {
+	double bytes_per_sec;	/* output rate */
+	double reject_rate;	/* share of rejected Von-Neuman pairs */
+	__u64 fallbacks;	/* bits taken without unbias */
+	double min_entropy;	/* MCV estimate of the low 8 bits of a delta */
+};
+
+#define BENCH_SAMPLES 100000
+
+__u64 bench_ns(clockid_t clock);
+int bench_pin(int cpu);
+int bench_measure(struct rand_data *ec, double seconds,
+		  size_t raw_samples, struct bench_sample *sample);
+
+/*
+ * Result set of one benchmark invocation. Every metric holds the values of
+ * all repeated runs so that the compare mode can derive confidence
+ * intervals. See jitterentropy-bench-results.c for the file format.
+ */
+#define BENCH_MAX_META 24
+#define BENCH_MAX_METRICS 512
+#define BENCH_MAX_RUNS 100
+
+struct bench_metric {
+	char name[64];		/* <mode>.<item>.<quantity>, no spaces */
+	char unit[16];
+	int higher_better;	/* 1 if a larger value is an improvement */
+	unsigned int nr;	/* number of runs */
+	double val[BENCH_MAX_RUNS];
+};
+
+struct bench_results {
+	unsigned int nr_meta;
+	char meta_key[BENCH_MAX_META][32];
+	char meta_val[BENCH_MAX_META][128];
+	unsigned int nr_metrics;
+	struct bench_metric metric[BENCH_MAX_METRICS];
+};
+
+void bench_results_init(struct bench_results *res, const char *mode,
+			const char *label);
+int bench_results_meta(struct bench_results *res, const char *key,
+		       const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+const char *bench_results_get_meta(const struct bench_results *res,
+				   const char *key);
+int bench_results_add(struct bench_results *res, const char *name,
+		      const char *unit, int higher_better, double val);
+int bench_results_write(const struct bench_results *res, const char *path);
+int bench_results_read(struct bench_results *res, const char *path);
+void bench_metric_stats(const struct bench_metric *m, double *mean,
+			double *sd);
+
+/* benchmark modes, called with the arguments following the mode */
+int bench_stress(int argc, char *argv[]);
+int bench_perf(int argc, char *argv[]);
+int bench_scale(int argc, char *argv[]);
+int bench_startup(int argc, char *argv[]);
+int bench_afalg(int argc, char *argv[]);
+int bench_compare(int argc, char *argv[]);
+
+#endif /* _JITTERENTROPY_BENCH_H */
@@ -0,0 +1,268 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Cache of pre-warmed entropy collectors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Allocating an entropy collector is expensive: it generates one random
+ * number to fill the entropy pool and, in FIPS mode, another one to prime
+ * the continuous test. Applications which allocate an entropy collector per
+ * request or connection pay that price every time.
+ *
+ * When the cache is started, a background thread keeps up to "depth"
+ * entropy collectors of one configuration ready. jent_entropy_collector_alloc
+ * hands out one of those if the requested configuration matches.
+ * jent_entropy_collector_free returns the entropy collector to the cache
+ * where it is wiped immediately and re-primed by the background thread
+ * before it is handed out again. Entropy collectors with a failed FIPS
+ * test are never recycled.
+ */
+
+#include <pthread.h>
+
+#include "jitterentropy.h"
+
+static struct jent_collector_cache {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int running;
+	int stopping;		/* jent_collector_cache_stop tears down */
+	unsigned int osr;
+	unsigned int flags;
+	unsigned int depth;
+	/* primed entropy collectors ready to be handed out */
+	struct rand_data **ready;
+	unsigned int nr_ready;
+	/* wiped entropy collectors waiting to be re-primed */
+	struct rand_data **wiped;
+	unsigned int nr_wiped;
+} Cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int jent_collector_cache_match(unsigned int osr, unsigned int flags)
+{
+	if (0 == osr)
+		osr = 1;
+	return (Cache.running && Cache.osr == osr && Cache.flags == flags);
+}
+
+/* Background thread: re-prime returned and allocate new entropy collectors */
+static void *jent_collector_cache_fill(void *arg)
+{
+	pthread_mutex_lock(&Cache.lock);
+	while (Cache.running) {
+		struct rand_data *ec = NULL;
+
+		if (Cache.nr_wiped) {
+			ec = Cache.wiped[--Cache.nr_wiped];
+			pthread_mutex_unlock(&Cache.lock);
+			_jent_entropy_collector_prime(ec);
+		} else if (Cache.nr_ready < Cache.depth) {
+			pthread_mutex_unlock(&Cache.lock);
+			ec = _jent_entropy_collector_alloc(Cache.osr,
+							   Cache.flags);
+		} else {
+			pthread_cond_wait(&Cache.cond, &Cache.lock);
+			continue;
+		}
+
+		pthread_mutex_lock(&Cache.lock);
+		if (NULL == ec) {
+			/* allocation failed, retry when woken up */
+			pthread_cond_wait(&Cache.cond, &Cache.lock);
+			continue;
+		}
+		if (Cache.running && Cache.nr_ready < Cache.depth)
+			Cache.ready[Cache.nr_ready++] = ec;
+		else
+			_jent_entropy_collector_free(ec);
+	}
+	pthread_mutex_unlock(&Cache.lock);
+
+	return NULL;
+}
+
+/*
+ * Start the cache of pre-warmed entropy collectors.
+ *
+ * jent_entropy_init must have been called successfully before.
+ *
+ * @osr: oversampling rate of the cached entropy collectors
+ * @flags: flags of the cached entropy collectors
+ * @depth: number of entropy collectors kept ready
+ *
+ * return: 0 on success, -EBUSY if the cache is running or still being
+ *	   stopped, other values < 0 on error
+ */
+int jent_collector_cache_start(unsigned int osr, unsigned int flags,
+			       unsigned int depth)
+{
+	int ret = 0;
+
+	if (!depth)
+		return -EINVAL;
+
+	pthread_mutex_lock(&Cache.lock);
+	if (Cache.running || Cache.stopping) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	Cache.ready = jent_zalloc(depth * sizeof(struct rand_data *));
+	Cache.wiped = jent_zalloc(depth * sizeof(struct rand_data *));
+	if (NULL == Cache.ready || NULL == Cache.wiped) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	Cache.osr = osr ? osr : 1;
+	Cache.flags = flags;
+	Cache.depth = depth;
+	Cache.nr_ready = 0;
+	Cache.nr_wiped = 0;
+	Cache.running = 1;
+
+	ret = -pthread_create(&Cache.thread, NULL, jent_collector_cache_fill,
+			      NULL);
+	if (!ret)
+		goto out;
+	Cache.running = 0;
+
+err:
+	if (NULL != Cache.ready)
+		jent_zfree(Cache.ready, depth * sizeof(struct rand_data *));
+	if (NULL != Cache.wiped)
+		jent_zfree(Cache.wiped, depth * sizeof(struct rand_data *));
+	Cache.ready = NULL;
+	Cache.wiped = NULL;
+out:
+	pthread_mutex_unlock(&Cache.lock);
+	return ret;
+}
+
+/*
+ * Stop the cache and release all cached entropy collectors. Entropy
+ * collectors handed out before remain valid and are released regularly
+ * by jent_entropy_collector_free.
+ */
+void jent_collector_cache_stop(void)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&Cache.lock);
+	if (!Cache.running) {
+		pthread_mutex_unlock(&Cache.lock);
+		return;
+	}
+	Cache.running = 0;
+	/* keep jent_collector_cache_start away until the teardown is done */
+	Cache.stopping = 1;
+	pthread_cond_signal(&Cache.cond);
+	pthread_mutex_unlock(&Cache.lock);
+
+	pthread_join(Cache.thread, NULL);
+
+	pthread_mutex_lock(&Cache.lock);
+	for (i = 0; i < Cache.nr_ready; i++)
+		_jent_entropy_collector_free(Cache.ready[i]);
+	for (i = 0; i < Cache.nr_wiped; i++)
+		_jent_entropy_collector_free(Cache.wiped[i]);
+	jent_zfree(Cache.ready, Cache.depth * sizeof(struct rand_data *));
+	jent_zfree(Cache.wiped, Cache.depth * sizeof(struct rand_data *));
+	Cache.ready = NULL;
+	Cache.wiped = NULL;
+	Cache.nr_ready = 0;
+	Cache.nr_wiped = 0;
+	Cache.stopping = 0;
+	pthread_mutex_unlock(&Cache.lock);
+}
+
+/*
+ * Take a primed entropy collector out of the cache.
+ *
+ * return: entropy collector or NULL if the cache is not running, has a
+ *	   different configuration or is empty
+ */
+struct rand_data *jent_collector_cache_get(unsigned int osr,
+					   unsigned int flags)
+{
+	struct rand_data *ec = NULL;
+
+	pthread_mutex_lock(&Cache.lock);
+	if (jent_collector_cache_match(osr, flags) && Cache.nr_ready) {
+		ec = Cache.ready[--Cache.nr_ready];
+		Cache.ready[Cache.nr_ready] = NULL;
+		pthread_cond_signal(&Cache.cond);
+	}
+	pthread_mutex_unlock(&Cache.lock);
+
+	return ec;
+}
+
+/*
+ * Return an entropy collector to the cache. The entropy collector is wiped
+ * right away. Instrumented entropy collectors are refused as their owner may
+ * still hold on to the data handed to the trace callback.
+ *
+ * return: 0 if the cache took the entropy collector, < 0 if the caller must
+ *	   free it
+ */
+int jent_collector_cache_put(struct rand_data *entropy_collector)
+{
+	int ret = -1;
+
+	if (NULL == entropy_collector || entropy_collector->fips_fail)
+		return -1;
+#ifdef JENT_INSTRUMENT
+	if (entropy_collector->instrument)
+		return -1;
+#endif
+
+	pthread_mutex_lock(&Cache.lock);
+	if (jent_collector_cache_match(entropy_collector->osr,
+				       entropy_collector->flags) &&
+	    (Cache.nr_ready + Cache.nr_wiped) < Cache.depth) {
+		_jent_entropy_collector_wipe(entropy_collector);
+		Cache.wiped[Cache.nr_wiped++] = entropy_collector;
+		pthread_cond_signal(&Cache.cond);
+		ret = 0;
+	}
+	pthread_mutex_unlock(&Cache.lock);
+
+	return ret;
+}
@@ -0,0 +1,560 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Compact indexed capture format for raw time deltas
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Captures of raw time deltas hold billions of samples. Stored as plain
+ * 64 bit words, they waste most of the space as consecutive deltas differ
+ * by a few hundred timer ticks at most. The format described in
+ * jitterentropy-capture.h stores those differences as varints which needs
+ * one or two bytes per sample. The chunk index allows random access and
+ * decoding the chunks in parallel: jent_capture_read_chunk only uses
+ * pread and may be called by several threads at once.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "jitterentropy-capture.h"
+
+#define JENT_CAPTURE_IDX_SIZE	16
+/* maximum size of one varint */
+#define JENT_CAPTURE_VARINT	10
+#define JENT_CAPTURE_CLOCKSOURCE "/sys/devices/system/clocksource/clocksource0/current_clocksource"
+
+struct jent_capture_idx {
+	__u64 offset;
+	__u32 bytes;
+	__u32 samples;
+};
+
+struct jent_capture {
+	int fd;
+	int writing;
+	struct jent_capture_meta meta;
+	struct jent_capture_idx *idx;
+	__u64 nr_idx;		/* allocated index entries */
+	__u64 offset;		/* end of the written data */
+	/* samples of the chunk being written and its encoding */
+	__u64 *chunk;
+	__u32 fill;
+	__u8 *enc;
+};
+
+static void jent_capture_put32(__u8 *p, __u32 v)
+{
+	unsigned int i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static void jent_capture_put64(__u8 *p, __u64 v)
+{
+	unsigned int i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static __u32 jent_capture_get32(const __u8 *p)
+{
+	__u32 v = 0;
+	unsigned int i;
+
+	for (i = 0; i < 4; i++)
+		v |= (__u32)p[i] << (8 * i);
+	return v;
+}
+
+static __u64 jent_capture_get64(const __u8 *p)
+{
+	__u64 v = 0;
+	unsigned int i;
+
+	for (i = 0; i < 8; i++)
+		v |= (__u64)p[i] << (8 * i);
+	return v;
+}
+
+static int jent_capture_pwrite(int fd, const void *buf, size_t len,
+			       __u64 offset)
+{
+	const __u8 *p = buf;
+
+	while (len) {
+		ssize_t ret = pwrite(fd, p, len, offset);
+
+		if (0 > ret) {
+			if (EINTR == errno)
+				continue;
+			return -errno;
+		}
+		p += ret;
+		len -= ret;
+		offset += ret;
+	}
+	return 0;
+}
+
+static int jent_capture_pread(int fd, void *buf, size_t len, __u64 offset)
+{
+	__u8 *p = buf;
+
+	while (len) {
+		ssize_t ret = pread(fd, p, len, offset);
+
+		if (0 > ret) {
+			if (EINTR == errno)
+				continue;
+			return -errno;
+		}
+		if (!ret)
+			return -EIO;
+		p += ret;
+		len -= ret;
+		offset += ret;
+	}
+	return 0;
+}
+
+/* first line of @name starting with @key, without the key */
+static void jent_capture_read_line(const char *name, const char *key,
+				   char *buf, size_t len)
+{
+	FILE *f = fopen(name, "r");
+	char line[256];
+	size_t keylen = strlen(key);
+
+	if (NULL == f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		char *val = line + keylen;
+
+		if (strncmp(line, key, keylen))
+			continue;
+		/* skip the separator of /proc/cpuinfo */
+		while (*val == ' ' || *val == '\t' || *val == ':')
+			val++;
+		val[strcspn(val, "\n")] = '\0';
+		strncpy(buf, val, len - 1);
+		buf[len - 1] = '\0';
+		break;
+	}
+	fclose(f);
+}
+
+void jent_capture_meta_init(struct jent_capture_meta *meta, unsigned int osr,
+			    unsigned int flags)
+{
+	memset(meta, 0, sizeof(*meta));
+	meta->chunk_samples = JENT_CAPTURE_CHUNK;
+	meta->osr = osr ? osr : 1;
+	meta->flags = flags;
+	meta->created = time(NULL);
+	gethostname(meta->host, sizeof(meta->host) - 1);
+	jent_capture_read_line("/proc/cpuinfo", "model name", meta->cpu,
+			       sizeof(meta->cpu));
+	jent_capture_read_line(JENT_CAPTURE_CLOCKSOURCE, "", meta->timer,
+			       sizeof(meta->timer));
+}
+
+static void jent_capture_free(struct jent_capture *cap)
+{
+	if (0 <= cap->fd)
+		close(cap->fd);
+	free(cap->idx);
+	free(cap->chunk);
+	free(cap->enc);
+	free(cap);
+}
+
+static int jent_capture_write_hdr(struct jent_capture *cap, __u64 index)
+{
+	__u8 hdr[JENT_CAPTURE_HDR_SIZE];
+	const struct jent_capture_meta *meta = &cap->meta;
+
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, JENT_CAPTURE_MAGIC, 8);
+	jent_capture_put32(hdr + 8, JENT_CAPTURE_VERSION);
+	jent_capture_put32(hdr + 12, JENT_CAPTURE_HDR_SIZE);
+	jent_capture_put32(hdr + 16, meta->chunk_samples);
+	jent_capture_put32(hdr + 20, meta->osr);
+	jent_capture_put32(hdr + 24, meta->flags);
+	jent_capture_put64(hdr + 32, meta->nr_samples);
+	jent_capture_put64(hdr + 40, meta->nr_chunks);
+	jent_capture_put64(hdr + 48, index);
+	jent_capture_put64(hdr + 56, meta->created);
+	strncpy((char *)hdr + 64, meta->host, 63);
+	strncpy((char *)hdr + 128, meta->cpu, 95);
+	strncpy((char *)hdr + 224, meta->timer, 31);
+
+	return jent_capture_pwrite(cap->fd, hdr, sizeof(hdr), 0);
+}
+
+/*
+ * Create a capture file.
+ *
+ * @name: file name
+ * @meta: description of the capture, the sample and chunk counts are
+ *	  maintained by jent_capture_write
+ *
+ * return: capture or NULL on error with errno set
+ */
+struct jent_capture *jent_capture_create(const char *name,
+					 const struct jent_capture_meta *meta)
+{
+	struct jent_capture *cap = calloc(1, sizeof(*cap));
+	int err = ENOMEM;
+
+	if (NULL == cap)
+		return NULL;
+	cap->fd = -1;
+	cap->writing = 1;
+	cap->meta = *meta;
+	cap->meta.nr_samples = 0;
+	cap->meta.nr_chunks = 0;
+	if (!cap->meta.chunk_samples)
+		cap->meta.chunk_samples = JENT_CAPTURE_CHUNK;
+
+	cap->chunk = malloc(cap->meta.chunk_samples * sizeof(__u64));
+	cap->enc = malloc(cap->meta.chunk_samples * JENT_CAPTURE_VARINT);
+	if (NULL == cap->chunk || NULL == cap->enc)
+		goto err;
+
+	cap->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (0 > cap->fd) {
+		err = errno;
+		goto err;
+	}
+	err = -jent_capture_write_hdr(cap, 0);
+	if (err)
+		goto err;
+	cap->offset = JENT_CAPTURE_HDR_SIZE;
+
+	return cap;
+
+err:
+	jent_capture_free(cap);
+	errno = err;
+	return NULL;
+}
+
+static size_t jent_capture_encode(const __u64 *samples, __u32 n, __u8 *enc)
+{
+	__u64 prev = 0;
+	size_t len = 0;
+	__u32 i;
+
+	for (i = 0; i < n; i++) {
+		__s64 d = (__s64)(samples[i] - prev);
+		__u64 z = ((__u64)d << 1) ^ (__u64)(d >> 63);
+
+		while (z >= 0x80) {
+			enc[len++] = (z & 0x7f) | 0x80;
+			z >>= 7;
+		}
+		enc[len++] = z;
+		prev = samples[i];
+	}
+
+	return len;
+}
+
+static int jent_capture_flush(struct jent_capture *cap)
+{
+	struct jent_capture_idx *idx;
+	size_t len;
+	int ret;
+
+	if (!cap->fill)
+		return 0;
+
+	if (cap->meta.nr_chunks == cap->nr_idx) {
+		__u64 nr = cap->nr_idx ? 2 * cap->nr_idx : 64;
+
+		idx = realloc(cap->idx, nr * sizeof(*idx));
+		if (NULL == idx)
+			return -ENOMEM;
+		cap->idx = idx;
+		cap->nr_idx = nr;
+	}
+
+	len = jent_capture_encode(cap->chunk, cap->fill, cap->enc);
+	ret = jent_capture_pwrite(cap->fd, cap->enc, len, cap->offset);
+	if (ret)
+		return ret;
+
+	idx = &cap->idx[cap->meta.nr_chunks++];
+	idx->offset = cap->offset;
+	idx->bytes = len;
+	idx->samples = cap->fill;
+	cap->offset += len;
+	cap->meta.nr_samples += cap->fill;
+	cap->fill = 0;
+
+	return 0;
+}
+
+/*
+ * Append samples to a capture.
+ *
+ * return: 0 on success, < 0 on error
+ */
+int jent_capture_write(struct jent_capture *cap, const __u64 *samples,
+		       size_t n)
+{
+	while (n) {
+		size_t todo = cap->meta.chunk_samples - cap->fill;
+		int ret;
+
+		if (todo > n)
+			todo = n;
+		memcpy(cap->chunk + cap->fill, samples, todo * sizeof(__u64));
+		cap->fill += todo;
+		samples += todo;
+		n -= todo;
+
+		if (cap->fill < cap->meta.chunk_samples)
+			break;
+		ret = jent_capture_flush(cap);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Open a capture file for reading.
+ *
+ * return: capture or NULL on error with errno set, EINVAL denotes a file
+ *	   which is not a capture, EBADMSG a capture which is incomplete or
+ *	   whose index is inconsistent
+ */
+struct jent_capture *jent_capture_open(const char *name)
+{
+	struct jent_capture *cap = calloc(1, sizeof(*cap));
+	struct jent_capture_meta *meta;
+	__u8 hdr[JENT_CAPTURE_HDR_SIZE];
+	__u8 *raw = NULL;
+	__u64 index, i, total = 0;
+	int err = ENOMEM;
+
+	if (NULL == cap)
+		return NULL;
+	meta = &cap->meta;
+	cap->fd = open(name, O_RDONLY);
+	if (0 > cap->fd) {
+		err = errno;
+		goto err;
+	}
+
+	err = EINVAL;
+	if (jent_capture_pread(cap->fd, hdr, sizeof(hdr), 0) ||
+	    memcmp(hdr, JENT_CAPTURE_MAGIC, 8))
+		goto err;
+
+	err = EBADMSG;
+	if (JENT_CAPTURE_VERSION != jent_capture_get32(hdr + 8) ||
+	    JENT_CAPTURE_HDR_SIZE > jent_capture_get32(hdr + 12))
+		goto err;
+
+	meta->chunk_samples = jent_capture_get32(hdr + 16);
+	meta->osr = jent_capture_get32(hdr + 20);
+	meta->flags = jent_capture_get32(hdr + 24);
+	meta->nr_samples = jent_capture_get64(hdr + 32);
+	meta->nr_chunks = jent_capture_get64(hdr + 40);
+	index = jent_capture_get64(hdr + 48);
+	meta->created = jent_capture_get64(hdr + 56);
+	memcpy(meta->host, hdr + 64, 63);
+	memcpy(meta->cpu, hdr + 128, 95);
+	memcpy(meta->timer, hdr + 224, 31);
+	/* an interrupted capture has no index */
+	if (!index || !meta->chunk_samples ||
+	    meta->nr_chunks > meta->nr_samples)
+		goto err;
+
+	err = ENOMEM;
+	cap->nr_idx = meta->nr_chunks;
+	cap->idx = calloc(cap->nr_idx ? cap->nr_idx : 1, sizeof(*cap->idx));
+	raw = malloc((cap->nr_idx ? cap->nr_idx : 1) * JENT_CAPTURE_IDX_SIZE);
+	if (NULL == cap->idx || NULL == raw)
+		goto err;
+	err = EBADMSG;
+	if (jent_capture_pread(cap->fd, raw,
+			       cap->nr_idx * JENT_CAPTURE_IDX_SIZE, index))
+		goto err;
+	for (i = 0; i < cap->nr_idx; i++) {
+		struct jent_capture_idx *idx = &cap->idx[i];
+		const __u8 *p = raw + i * JENT_CAPTURE_IDX_SIZE;
+
+		idx->offset = jent_capture_get64(p);
+		idx->bytes = jent_capture_get32(p + 8);
+		idx->samples = jent_capture_get32(p + 12);
+		if (idx->samples > meta->chunk_samples ||
+		    idx->bytes > (__u64)idx->samples * JENT_CAPTURE_VARINT)
+			goto err;
+		/* readers locate chunk i at sample i * chunk_samples: all
+		 * chunks but the last one must be full */
+		if (!idx->samples ||
+		    (i + 1 < cap->nr_idx && idx->samples != meta->chunk_samples))
+			goto err;
+		total += idx->samples;
+	}
+	if (total != meta->nr_samples)
+		goto err;
+	free(raw);
+
+	return cap;
+
+err:
+	free(raw);
+	jent_capture_free(cap);
+	errno = err;
+	return NULL;
+}
+
+const struct jent_capture_meta *jent_capture_get_meta(struct jent_capture *cap)
+{
+	return &cap->meta;
+}
+
+/*
+ * Decode one chunk of a capture. Safe to be called in parallel.
+ *
+ * @cap: capture opened with jent_capture_open
+ * @chunk: chunk number
+ * @samples: buffer for chunk_samples samples
+ *
+ * return: number of samples, < 0 on error
+ */
+int jent_capture_read_chunk(struct jent_capture *cap, __u64 chunk,
+			    __u64 *samples)
+{
+	const struct jent_capture_idx *idx;
+	__u8 *enc;
+	__u64 prev = 0;
+	size_t pos = 0;
+	__u32 i;
+	int ret;
+
+	if (cap->writing || chunk >= cap->meta.nr_chunks)
+		return -EINVAL;
+	idx = &cap->idx[chunk];
+
+	enc = malloc(idx->bytes ? idx->bytes : 1);
+	if (NULL == enc)
+		return -ENOMEM;
+	ret = jent_capture_pread(cap->fd, enc, idx->bytes, idx->offset);
+	if (ret)
+		goto out;
+
+	ret = -EINVAL;
+	for (i = 0; i < idx->samples; i++) {
+		__u64 z = 0;
+		unsigned int shift = 0;
+
+		do {
+			if (pos >= idx->bytes || shift > 63)
+				goto out;
+			z |= (__u64)(enc[pos] & 0x7f) << shift;
+			shift += 7;
+		} while (enc[pos++] & 0x80);
+
+		prev += (z >> 1) ^ (~(z & 1) + 1);
+		samples[i] = prev;
+	}
+	ret = idx->samples;
+
+out:
+	free(enc);
+	return ret;
+}
+
+/*
+ * Close a capture. A capture being written gets completed by writing the
+ * last chunk, the chunk index and the final header.
+ *
+ * return: 0 on success, < 0 if the capture could not be completed
+ */
+int jent_capture_close(struct jent_capture *cap)
+{
+	__u8 *raw = NULL;
+	__u64 i;
+	int ret = 0;
+
+	if (NULL == cap)
+		return 0;
+	if (!cap->writing)
+		goto out;
+
+	ret = jent_capture_flush(cap);
+	if (ret)
+		goto out;
+	raw = malloc((cap->meta.nr_chunks ? cap->meta.nr_chunks : 1) *
+		     JENT_CAPTURE_IDX_SIZE);
+	if (NULL == raw) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < cap->meta.nr_chunks; i++) {
+		__u8 *p = raw + i * JENT_CAPTURE_IDX_SIZE;
+
+		jent_capture_put64(p, cap->idx[i].offset);
+		jent_capture_put32(p + 8, cap->idx[i].bytes);
+		jent_capture_put32(p + 12, cap->idx[i].samples);
+	}
+	ret = jent_capture_pwrite(cap->fd, raw,
+				  cap->meta.nr_chunks * JENT_CAPTURE_IDX_SIZE,
+				  cap->offset);
+	if (!ret)
+		ret = jent_capture_write_hdr(cap, cap->offset);
+	if (!ret && fsync(cap->fd))
+		ret = -errno;
+	free(raw);
+
+out:
+	jent_capture_free(cap);
+	return ret;
+}
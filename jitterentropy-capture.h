@@ -0,0 +1,86 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Compact indexed capture format for raw time deltas
+ *
+ * See jitterentropy-capture.c for the license.
+ */
+
+#ifndef _JITTERENTROPY_CAPTURE_H
+#define _JITTERENTROPY_CAPTURE_H
+
+#include "jitterentropy.h"
+
+/*
+ * File layout, all integers are little endian:
+ *
+ * Header of JENT_CAPTURE_HDR_SIZE bytes:
+ *	offset	size	content
+ *	0	8	magic "JENTCAP1"
+ *	8	4	format version, currently 1
+ *	12	4	header size
+ *	16	4	samples per chunk, all chunks but the last are full
+ *	20	4	oversampling rate of the entropy collector
+ *	24	4	flags of the entropy collector
+ *	28	4	reserved, 0
+ *	32	8	number of samples
+ *	40	8	number of chunks
+ *	48	8	file offset of the chunk index, 0 while the capture is
+ *			being written
+ *	56	8	creation time in seconds since the epoch
+ *	64	64	host name, NUL padded
+ *	128	96	CPU model, NUL padded
+ *	224	32	timer backend (clocksource of the kernel), NUL padded
+ *
+ * Chunks follow the header back to back. Every chunk is decoded on its
+ * own: its first sample is stored as is, every further sample as the
+ * difference to its predecessor. As the samples are time deltas, this is
+ * the delta-of-delta of the time stamps. Each value is mapped to an
+ * unsigned integer by zigzag encoding (0, -1, 1, -2, ... become 0, 1, 2,
+ * 3, ...) and written as varint: 7 bits per byte, least significant group
+ * first, the high bit set on all bytes but the last.
+ *
+ * The chunk index follows the last chunk with 16 bytes per chunk:
+ *	0	8	file offset of the chunk
+ *	8	4	size of the chunk in bytes
+ *	12	4	number of samples in the chunk
+ */
+#define JENT_CAPTURE_MAGIC	"JENTCAP1"
+#define JENT_CAPTURE_VERSION	1
+#define JENT_CAPTURE_HDR_SIZE	256
+#define JENT_CAPTURE_CHUNK	65536
+
+struct jent_capture_meta {
+	__u32 chunk_samples;
+	__u32 osr;
+	__u32 flags;
+	__u64 nr_samples;
+	__u64 nr_chunks;
+	__u64 created;
+	char host[64];
+	char cpu[96];
+	char timer[32];
+};
+
+struct jent_capture;
+
+/* fill in the description of this host and the collector configuration */
+void jent_capture_meta_init(struct jent_capture_meta *meta, unsigned int osr,
+			    unsigned int flags);
+
+/* writing of a capture */
+struct jent_capture *jent_capture_create(const char *name,
+					 const struct jent_capture_meta *meta);
+int jent_capture_write(struct jent_capture *cap, const __u64 *samples,
+		       size_t n);
+
+/* reading of a capture */
+struct jent_capture *jent_capture_open(const char *name);
+const struct jent_capture_meta *jent_capture_get_meta(struct jent_capture *cap);
+int jent_capture_read_chunk(struct jent_capture *cap, __u64 chunk,
+			    __u64 *samples);
+
+/* completes a capture being written */
+int jent_capture_close(struct jent_capture *cap);
+
+#endif /* _JITTERENTROPY_CAPTURE_H */
@@ -0,0 +1,924 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Min-entropy estimators for the raw time deltas
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * The estimators follow NIST SP 800-90B section 6.3. They are used for
+ * quick assessments of the noise source at runtime and by the offline
+ * tools. They require floating point support and are not available in the
+ * kernel.
+ */
+
+#include <math.h>
+
+#include "jitterentropy-estimate.h"
+
+static int jent_est_cmp_u64(const void *a, const void *b)
+{
+	__u64 x = *(const __u64 *)a;
+	__u64 y = *(const __u64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* upper bound of the 99% confidence interval of a proportion */
+double jent_est_upper_bound(double p, size_t n)
+{
+	if (2 > n)
+		return 1.0;
+	p += 2.576 * sqrt(p * (1.0 - p) / (double)(n - 1));
+	return (p > 1.0) ? 1.0 : p;
+}
+
+/*
+ * Most common value estimate (SP 800-90B section 6.3.1)
+ *
+ * return: min-entropy per sample in bits, < 0 on error
+ */
+double jent_est_mcv(const __u64 *samples, size_t n)
+{
+	__u64 *sorted;
+	size_t i, run = 1, max_run = 1;
+	double pu;
+
+	if (!n)
+		return -1;
+
+	sorted = malloc(n * sizeof(__u64));
+	if (NULL == sorted)
+		return -1;
+	memcpy(sorted, samples, n * sizeof(__u64));
+	qsort(sorted, n, sizeof(__u64), jent_est_cmp_u64);
+
+	for (i = 1; i < n; i++) {
+		if (sorted[i] == sorted[i - 1])
+			run++;
+		else
+			run = 1;
+		if (run > max_run)
+			max_run = run;
+	}
+	memset(sorted, 0, n * sizeof(__u64));
+	free(sorted);
+
+	pu = jent_est_upper_bound((double)max_run / (double)n, n);
+	return -log2(pu);
+}
+
+/*
+ * The following estimators operate on symbols of up to 8 bits derived from
+ * the time deltas. The estimators defined for binary data only (collision,
+ * Markov and compression) take a bit string holding one bit per byte. Their
+ * result is given per bit and must be scaled by the caller to the symbol
+ * width.
+ *
+ * All estimators return the min-entropy in bits, INFINITY if the estimator
+ * is not applicable to the data (it does not bound the entropy then) or
+ * a value < 0 on error. They do not use any global state and can run in
+ * parallel.
+ */
+
+/* z-value of the 99% confidence interval */
+#define JENT_EST_Z		2.576
+/* number of bisection steps when solving for a probability */
+#define JENT_EST_BISECT		64
+
+/*
+ * Most common value estimate on symbols (SP 800-90B section 6.3.1)
+ */
+double jent_est_mcv_sym(const __u8 *sym, size_t n)
+{
+	size_t count[256] = { 0 };
+	size_t i, max = 0;
+
+	if (!n)
+		return -1;
+
+	for (i = 0; i < n; i++)
+		count[sym[i]]++;
+	for (i = 0; i < 256; i++) {
+		if (count[i] > max)
+			max = count[i];
+	}
+
+	return -log2(jent_est_upper_bound((double)max / (double)n, n));
+}
+
+/*
+ * Expected collision time of a binary source with probability p of the
+ * more likely value -- F(q) of SP 800-90B uses the incomplete gamma
+ * function Gamma(3, 1/q) which has the closed form used here.
+ */
+static double jent_est_collision_exp(double p)
+{
+	double q = 1.0 - p;
+	double f = 2.0 * q * q * q + 2.0 * q * q + q;
+	double d = 0.5 * (1.0 / p - 1.0 / q);
+
+	return p / (q * q) * (1.0 + d) * f - p / q * d;
+}
+
+/*
+ * Collision estimate (SP 800-90B section 6.3.2)
+ *
+ * @bits: bit string, one bit per byte
+ * @n: number of bits
+ */
+double jent_est_collision(const __u8 *bits, size_t n)
+{
+	double sum = 0, sum2 = 0, mean, sigma, lo = 0.5, hi = 1.0;
+	size_t i = 0, v = 0;
+	unsigned int j;
+
+	/* with two symbols, a collision occurs after two or three bits */
+	while (i + 1 < n) {
+		unsigned int t;
+
+		if (bits[i] == bits[i + 1]) {
+			t = 2;
+		} else if (i + 2 < n) {
+			t = 3;
+		} else {
+			break;
+		}
+		sum += t;
+		sum2 += t * t;
+		v++;
+		i += t;
+	}
+	if (2 > v)
+		return -1;
+
+	mean = sum / (double)v;
+	sigma = sqrt((sum2 - (double)v * mean * mean) / (double)(v - 1));
+	mean -= JENT_EST_Z * sigma / sqrt((double)v);
+
+	/* no solution: the data looks like a fair coin */
+	if (mean >= jent_est_collision_exp(0.5))
+		return 1.0;
+
+	/* expected collision time decreases with growing p */
+	for (j = 0; j < JENT_EST_BISECT; j++) {
+		double p = (lo + hi) / 2;
+
+		if (jent_est_collision_exp(p) > mean)
+			lo = p;
+		else
+			hi = p;
+	}
+
+	return -log2((lo + hi) / 2);
+}
+
+/* log2 of a probability which may be zero */
+static double jent_est_log2(double p)
+{
+	return (p > 0) ? log2(p) : -INFINITY;
+}
+
+/*
+ * Markov estimate (SP 800-90B section 6.3.3)
+ *
+ * @bits: bit string, one bit per byte
+ * @n: number of bits
+ */
+double jent_est_markov(const __u8 *bits, size_t n)
+{
+	size_t ones = 0, trans[2][2] = { { 0, 0 }, { 0, 0 } };
+	double p0, p1, p00, p01, p10, p11, lmax;
+	double cand[6];
+	unsigned int j;
+	size_t i;
+
+	if (2 > n)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		ones += bits[i];
+		if (i)
+			trans[bits[i - 1]][bits[i]]++;
+	}
+
+	p1 = jent_est_log2((double)ones / (double)n);
+	p0 = jent_est_log2((double)(n - ones) / (double)n);
+	p00 = (trans[0][0] + trans[0][1]) ?
+		jent_est_log2((double)trans[0][0] /
+			      (double)(trans[0][0] + trans[0][1])) : -INFINITY;
+	p01 = (trans[0][0] + trans[0][1]) ?
+		jent_est_log2((double)trans[0][1] /
+			      (double)(trans[0][0] + trans[0][1])) : -INFINITY;
+	p10 = (trans[1][0] + trans[1][1]) ?
+		jent_est_log2((double)trans[1][0] /
+			      (double)(trans[1][0] + trans[1][1])) : -INFINITY;
+	p11 = (trans[1][0] + trans[1][1]) ?
+		jent_est_log2((double)trans[1][1] /
+			      (double)(trans[1][0] + trans[1][1])) : -INFINITY;
+
+	/* most likely 128 bit sequences, computed in the log domain */
+	cand[0] = p0 + 127 * p00;
+	cand[1] = p0 + 64 * p01 + 63 * p10;
+	cand[2] = p0 + p01 + 126 * p11;
+	cand[3] = p1 + p10 + 126 * p00;
+	cand[4] = p1 + 64 * p10 + 63 * p01;
+	cand[5] = p1 + 127 * p11;
+
+	lmax = cand[0];
+	for (j = 1; j < 6; j++) {
+		if (cand[j] > lmax)
+			lmax = cand[j];
+	}
+
+	lmax = -lmax / 128;
+	return (lmax > 1.0) ? 1.0 : lmax;
+}
+
+#define JENT_EST_COMP_B		6
+#define JENT_EST_COMP_SYMS	(1 << JENT_EST_COMP_B)
+#define JENT_EST_COMP_D		1000
+
+/*
+ * Expected value of the compression statistic G(z) of SP 800-90B. The
+ * inner sum over t is folded: log2(u) z^2 (1-z)^(u-1) occurs once for each
+ * t > max(u, d).
+ */
+static double jent_est_compression_g(double z, const double *log2u,
+				     size_t l, size_t v)
+{
+	double pw = 1.0, sum = 0;
+	size_t u;
+
+	for (u = 1; u <= l; u++) {
+		size_t cnt;
+
+		/* pw = (1 - z)^(u - 1) */
+		if (u < l) {
+			cnt = l - ((u > JENT_EST_COMP_D) ? u : JENT_EST_COMP_D);
+			sum += log2u[u] * z * z * pw * (double)cnt;
+		}
+		if (u > JENT_EST_COMP_D)
+			sum += log2u[u] * z * pw;
+		pw *= (1.0 - z);
+		/* the remaining terms vanish, avoid slow denormal arithmetic */
+		if (pw < 1e-300)
+			break;
+	}
+
+	return sum / (double)v;
+}
+
+static double jent_est_compression_exp(double p, const double *log2u,
+				       size_t l, size_t v)
+{
+	double q = (1.0 - p) / (JENT_EST_COMP_SYMS - 1);
+
+	return jent_est_compression_g(p, log2u, l, v) +
+	       (JENT_EST_COMP_SYMS - 1) *
+	       jent_est_compression_g(q, log2u, l, v);
+}
+
+/*
+ * Compression estimate (SP 800-90B section 6.3.4)
+ *
+ * @bits: bit string, one bit per byte
+ * @n: number of bits
+ */
+double jent_est_compression(const __u8 *bits, size_t n)
+{
+	size_t dict[JENT_EST_COMP_SYMS] = { 0 };
+	size_t l = n / JENT_EST_COMP_B, v, i;
+	double *log2u = NULL;
+	double sum = 0, sum2 = 0, mean, sigma;
+	double lo = 1.0 / JENT_EST_COMP_SYMS, hi = 1.0;
+	unsigned int j;
+
+	if (l <= JENT_EST_COMP_D + 1)
+		return -1;
+	v = l - JENT_EST_COMP_D;
+
+	log2u = malloc((l + 1) * sizeof(double));
+	if (NULL == log2u)
+		return -1;
+	log2u[0] = 0;
+	for (i = 1; i <= l; i++)
+		log2u[i] = log2((double)i);
+
+	for (i = 1; i <= l; i++) {
+		const __u8 *b = bits + (i - 1) * JENT_EST_COMP_B;
+		unsigned int s = 0;
+
+		for (j = 0; j < JENT_EST_COMP_B; j++)
+			s = (s << 1) | b[j];
+
+		if (i > JENT_EST_COMP_D) {
+			double d = log2u[dict[s] ? (i - dict[s]) : i];
+
+			sum += d;
+			sum2 += d * d;
+		}
+		dict[s] = i;
+	}
+
+	mean = sum / (double)v;
+	sigma = sum2 / (double)(v - 1) - mean * mean;
+	sigma = (sigma > 0) ? 0.5907 * sqrt(sigma) : 0;
+	mean -= JENT_EST_Z * sigma / sqrt((double)v);
+
+	if (mean >= jent_est_compression_exp(lo, log2u, l, v)) {
+		hi = lo;
+	} else {
+		/* the expected value decreases with growing p */
+		for (j = 0; j < JENT_EST_BISECT; j++) {
+			double p = (lo + hi) / 2;
+
+			if (jent_est_compression_exp(p, log2u, l, v) > mean)
+				lo = p;
+			else
+				hi = p;
+		}
+	}
+	free(log2u);
+
+	return -log2((lo + hi) / 2) / JENT_EST_COMP_B;
+}
+
+/*
+ * Suffix array of @s by prefix doubling with radix sort.
+ *
+ * @rank and @tmp are scratch arrays of @n entries, @cnt has
+ * max(@n, 256) entries.
+ */
+static void jent_est_suffix_array(const __u8 *s, __u32 n, __u32 *sa,
+				  __u32 *rank, __u32 *tmp, __u32 *cnt)
+{
+	__u32 *x = rank, *y = tmp, *t;
+	__u32 m = 256, i, k, p;
+
+	memset(cnt, 0, m * sizeof(__u32));
+	for (i = 0; i < n; i++)
+		cnt[x[i] = s[i]]++;
+	for (i = 1; i < m; i++)
+		cnt[i] += cnt[i - 1];
+	for (i = n; i > 0; i--)
+		sa[--cnt[x[i - 1]]] = i - 1;
+
+	for (k = 1; k < n; k <<= 1) {
+		/* order by the second half, suffixes without one first */
+		p = 0;
+		for (i = n - k; i < n; i++)
+			y[p++] = i;
+		for (i = 0; i < n; i++) {
+			if (sa[i] >= k)
+				y[p++] = sa[i] - k;
+		}
+
+		/* stable sort by the first half */
+		memset(cnt, 0, m * sizeof(__u32));
+		for (i = 0; i < n; i++)
+			cnt[x[y[i]]]++;
+		for (i = 1; i < m; i++)
+			cnt[i] += cnt[i - 1];
+		for (i = n; i > 0; i--)
+			sa[--cnt[x[y[i - 1]]]] = y[i - 1];
+
+		/* new ranks, 0 marks a missing second half */
+		t = x;
+		x = y;
+		y = t;
+		p = 1;
+		x[sa[0]] = 0;
+		for (i = 1; i < n; i++) {
+			__u32 a = sa[i - 1], b = sa[i];
+			__u32 ra = (a + k < n) ? y[a + k] + 1 : 0;
+			__u32 rb = (b + k < n) ? y[b + k] + 1 : 0;
+
+			x[b] = (y[a] == y[b] && ra == rb) ? p - 1 : p++;
+		}
+		if (p >= n)
+			break;
+		m = p;
+	}
+
+	/* leave the inverse suffix array in rank */
+	for (i = 0; i < n; i++)
+		rank[sa[i]] = i;
+}
+
+/*
+ * Longest common prefixes of adjacent suffixes (Kasai et al.):
+ * lcp[i] is the common prefix of the suffixes sa[i - 1] and sa[i].
+ */
+static __u32 jent_est_lcp(const __u8 *s, __u32 n, const __u32 *sa,
+			  const __u32 *rank, __u32 *lcp)
+{
+	__u32 i, h = 0, max = 0;
+
+	lcp[0] = 0;
+	for (i = 0; i < n; i++) {
+		if (rank[i]) {
+			__u32 j = sa[rank[i] - 1];
+
+			while (i + h < n && j + h < n && s[i + h] == s[j + h])
+				h++;
+			lcp[rank[i]] = h;
+			if (h > max)
+				max = h;
+			if (h)
+				h--;
+		} else {
+			h = 0;
+		}
+	}
+
+	return max;
+}
+
+struct jent_est_interval {
+	__u32 lcp;
+	__u32 lb;
+};
+
+/*
+ * t-tuple and LRS estimates (SP 800-90B sections 6.3.5 and 6.3.6)
+ *
+ * Both count repeated tuples of all lengths. A suffix array turns this into
+ * a single pass over the lcp intervals: an interval of c suffixes with the
+ * common prefix length l whose enclosing interval has the common prefix
+ * length lp is the set of occurrences of one W-tuple for each W in
+ * (lp, l].
+ *
+ * @sym: symbols
+ * @n: number of symbols, less than 2^32
+ * @t_tuple: t-tuple estimate
+ * @lrs: LRS estimate
+ *
+ * return: 0 on success, < 0 on error
+ */
+int jent_est_tuple(const __u8 *sym, size_t n, double *t_tuple, double *lrs)
+{
+#define JENT_EST_TUPLE_CUTOFF	35
+	__u32 *sa = NULL, *rank = NULL, *lcp = NULL, *cnt = NULL;
+	struct jent_est_interval *stack = NULL;
+	/* max. occurrences of one W-tuple and sum of C(c, 2) per W */
+	double *qmax = NULL, *pairs = NULL;
+	__u32 maxlcp, i, w, t, top = 0;
+	double pmax = 0, sum;
+	int ret = -ENOMEM;
+
+	if (2 > n || n >= 0xffffffffUL)
+		return -EINVAL;
+
+	sa = malloc(n * sizeof(__u32));
+	rank = malloc(n * sizeof(__u32));
+	lcp = malloc((n > 256 ? n : 256) * sizeof(__u32));
+	cnt = malloc((n > 256 ? n : 256) * sizeof(__u32));
+	if (NULL == sa || NULL == rank || NULL == lcp || NULL == cnt)
+		goto out;
+
+	/* lcp serves as scratch space while sorting */
+	jent_est_suffix_array(sym, n, sa, rank, lcp, cnt);
+	maxlcp = jent_est_lcp(sym, n, sa, rank, lcp);
+	free(rank);
+	rank = NULL;
+	free(cnt);
+	cnt = NULL;
+
+	stack = malloc((maxlcp + 2) * sizeof(*stack));
+	qmax = calloc(maxlcp + 2, sizeof(double));
+	pairs = calloc(maxlcp + 2, sizeof(double));
+	if (NULL == stack || NULL == qmax || NULL == pairs)
+		goto out;
+
+	/* bottom-up traversal of the lcp intervals */
+	stack[0].lcp = 0;
+	stack[0].lb = 0;
+	for (i = 1; i <= n; i++) {
+		__u32 cur = (i < n) ? lcp[i] : 0;
+		__u32 lb = i - 1;
+
+		while (cur < stack[top].lcp) {
+			struct jent_est_interval *iv = &stack[top--];
+			double c = (double)(i - iv->lb);
+			__u32 parent = (cur > stack[top].lcp) ?
+					cur : stack[top].lcp;
+
+			if (c > qmax[iv->lcp])
+				qmax[iv->lcp] = c;
+			/* difference array over W in (parent, lcp] */
+			pairs[parent + 1] += c * (c - 1) / 2;
+			pairs[iv->lcp + 1] -= c * (c - 1) / 2;
+			lb = iv->lb;
+		}
+		if (cur > stack[top].lcp) {
+			top++;
+			stack[top].lcp = cur;
+			stack[top].lb = lb;
+		}
+	}
+
+	/* a W-tuple occurring c times implies shorter tuples doing so */
+	for (w = maxlcp; w > 1; w--) {
+		if (qmax[w] > qmax[w - 1])
+			qmax[w - 1] = qmax[w];
+	}
+	sum = 0;
+	for (w = 1; w <= maxlcp + 1; w++) {
+		sum += pairs[w];
+		pairs[w] = sum;
+	}
+
+	/* t-tuple: all W with a tuple occurring at least 35 times */
+	for (t = 0; t < maxlcp && qmax[t + 1] >= JENT_EST_TUPLE_CUTOFF; t++) {
+		double p = pow(qmax[t + 1] / (double)(n - t), 1.0 / (t + 1));
+
+		if (p > pmax)
+			pmax = p;
+	}
+	if (t) {
+		pmax = jent_est_upper_bound(pmax, n);
+		*t_tuple = -log2(pmax);
+	} else {
+		*t_tuple = INFINITY;
+	}
+
+	/* LRS: from the first W not covered by t-tuple to the longest repeat */
+	pmax = 0;
+	for (w = t + 1; w <= maxlcp; w++) {
+		double tuples = (double)(n - w + 1);
+		double p = pow(pairs[w] / (tuples * (tuples - 1) / 2),
+			       1.0 / w);
+
+		if (p > pmax)
+			pmax = p;
+	}
+	if (t < maxlcp) {
+		pmax = jent_est_upper_bound(pmax, n);
+		*lrs = -log2(pmax);
+	} else {
+		*lrs = INFINITY;
+	}
+	ret = 0;
+
+out:
+	free(sa);
+	free(rank);
+	free(lcp);
+	free(cnt);
+	free(stack);
+	free(qmax);
+	free(pairs);
+	return ret;
+#undef JENT_EST_TUPLE_CUTOFF
+}
+
+/*
+ * Probability bound of the longest run of correct predictions (P_local of
+ * SP 800-90B section 6.3.7): solve
+ * 0.99 = (1 - p x) / ((r + 1 - r x) q) / x^(N + 1) for p.
+ */
+static double jent_est_local_fn(double p, size_t r, size_t n)
+{
+	double q = 1.0 - p, x = 1.0, pr = pow(p, (double)r);
+	unsigned int i;
+
+	for (i = 0; i < 10; i++)
+		x = 1.0 + q * pr * pow(x, (double)(r + 1));
+
+	return log(1.0 - p * x) - log(((double)(r + 1) - (double)r * x) * q) -
+	       (double)(n + 1) * log(x);
+}
+
+static double jent_est_local(size_t r, size_t n)
+{
+	double lo = 0, hi = 1.0, target = log(0.99);
+	unsigned int j;
+
+	/* the probability of no longer run decreases with growing p */
+	for (j = 0; j < JENT_EST_BISECT; j++) {
+		double p = (lo + hi) / 2;
+		double f = jent_est_local_fn(p, r, n);
+
+		if (isnan(f) || f < target)
+			hi = p;
+		else
+			lo = p;
+	}
+
+	return (lo + hi) / 2;
+}
+
+/*
+ * Min-entropy from the outcome of a predictor: @correct predictions out of
+ * @n with the longest run @run of correct predictions, @k symbols.
+ */
+static double jent_est_predictor(size_t correct, size_t n, size_t run,
+				 unsigned int k)
+{
+	double pglobal, plocal, p;
+
+	if (2 > n)
+		return -1;
+
+	if (correct) {
+		pglobal = jent_est_upper_bound((double)correct / (double)n, n);
+	} else {
+		pglobal = 1.0 - pow(0.01, 1.0 / (double)n);
+	}
+	plocal = jent_est_local(run + 1, n);
+
+	p = (pglobal > plocal) ? pglobal : plocal;
+	if (k && p < 1.0 / k)
+		p = 1.0 / k;
+
+	return -log2(p);
+}
+
+#define JENT_EST_MCW_WINDOWS	4
+
+struct jent_est_mcw {
+	size_t w;
+	__u32 count[256];
+	unsigned int mode;
+	size_t score;
+};
+
+/*
+ * Find the most common value of the window, ties are resolved in favor of
+ * the most recently observed value.
+ */
+static void jent_est_mcw_mode(struct jent_est_mcw *win, const size_t *last)
+{
+	unsigned int s;
+
+	for (s = 0; s < 256; s++) {
+		if (win->count[s] > win->count[win->mode] ||
+		    (win->count[s] && win->count[s] == win->count[win->mode] &&
+		     last[s] > last[win->mode]))
+			win->mode = s;
+	}
+}
+
+/*
+ * MultiMCW prediction estimate (SP 800-90B section 6.3.7)
+ *
+ * The most common value of each window is maintained incrementally and
+ * only recomputed when an occurrence of the current mode leaves the window.
+ *
+ * @sym: symbols
+ * @n: number of symbols
+ * @k: number of distinct symbols
+ */
+double jent_est_multi_mcw(const __u8 *sym, size_t n, unsigned int k)
+{
+	static const size_t w[JENT_EST_MCW_WINDOWS] = { 63, 255, 1023, 4095 };
+	struct jent_est_mcw *win;
+	/* position + 1 of the last occurrence of each symbol */
+	size_t last[256] = { 0 };
+	size_t i, correct = 0, run = 0, maxrun = 0;
+	unsigned int j, winner = 0;
+
+	if (n <= w[0] + 1)
+		return -1;
+
+	win = calloc(JENT_EST_MCW_WINDOWS, sizeof(*win));
+	if (NULL == win)
+		return -1;
+	for (j = 0; j < JENT_EST_MCW_WINDOWS; j++)
+		win[j].w = w[j];
+
+	for (i = 0; i < n; i++) {
+		/* predict sym[i] from the windows which are filled */
+		if (i >= w[0]) {
+			if (win[winner].mode == sym[i]) {
+				correct++;
+				if (++run > maxrun)
+					maxrun = run;
+			} else {
+				run = 0;
+			}
+
+			for (j = 0; j < JENT_EST_MCW_WINDOWS; j++) {
+				if (i < win[j].w || win[j].mode != sym[i])
+					continue;
+				if (++win[j].score >= win[winner].score)
+					winner = j;
+			}
+		}
+
+		/* slide the windows */
+		last[sym[i]] = i + 1;
+		for (j = 0; j < JENT_EST_MCW_WINDOWS; j++) {
+			struct jent_est_mcw *cur = &win[j];
+
+			if (i >= cur->w) {
+				__u8 old = sym[i - cur->w];
+
+				cur->count[old]--;
+				if (old == cur->mode)
+					jent_est_mcw_mode(cur, last);
+			}
+			if (++cur->count[sym[i]] >= cur->count[cur->mode])
+				cur->mode = sym[i];
+		}
+	}
+	free(win);
+
+	return jent_est_predictor(correct, n - w[0], maxrun, k);
+}
+
+/*
+ * Lag prediction estimate (SP 800-90B section 6.3.8)
+ *
+ * The prediction of the positions 1 to n - 1 can be split into ranges that
+ * are evaluated in parallel in two passes. jent_est_lag_count counts the
+ * matches per lag within every range. jent_est_lag_predict derives the
+ * scoreboard at the start of a range from the counts of all preceding
+ * ranges and predicts the range. jent_est_lag_finish combines the results.
+ *
+ * The winner is always a lag with the highest score. Among those, it is
+ * the lag that reached that score last -- the larger lag for matches at
+ * the same position -- so the winner at the start of a range follows from
+ * the count and the last match of every lag.
+ */
+
+/*
+ * Split the positions of @n symbols into at most @nr ranges of at least
+ * @min positions.
+ *
+ * return: number of ranges, 0 if there are too few symbols
+ */
+unsigned int jent_est_lag_split(size_t n, size_t min,
+				struct jent_est_lag_part *parts,
+				unsigned int nr)
+{
+	size_t len;
+	unsigned int p;
+
+	if (3 > n || !nr)
+		return 0;
+	if (!min)
+		min = 1;
+	if ((n - 1) / min < nr)
+		nr = (n - 1) / min;
+	if (!nr)
+		nr = 1;
+
+	len = (n - 1) / nr;
+	for (p = 0; p < nr; p++) {
+		parts[p].start = 1 + p * len;
+		parts[p].end = (p + 1 == nr) ? n : 1 + (p + 1) * len;
+	}
+
+	return nr;
+}
+
+/* count the matches per lag of the range @part */
+void jent_est_lag_count(const __u8 *sym, struct jent_est_lag_part *part)
+{
+	size_t i;
+	unsigned int d;
+
+	memset(part->score, 0, sizeof(part->score));
+	memset(part->last, 0, sizeof(part->last));
+	for (i = part->start; i < part->end; i++) {
+		for (d = 1; d <= JENT_EST_LAGS && d <= i; d++) {
+			if (sym[i - d] != sym[i])
+				continue;
+			part->score[d]++;
+			part->last[d] = i + 1;
+		}
+	}
+}
+
+/*
+ * Predict the range @idx of @parts -- jent_est_lag_count must have been
+ * applied to all preceding ranges.
+ */
+void jent_est_lag_predict(const __u8 *sym, struct jent_est_lag_part *parts,
+			  unsigned int idx)
+{
+	struct jent_est_lag_part *part = &parts[idx];
+	size_t score[JENT_EST_LAGS + 1] = { 0 };
+	size_t last[JENT_EST_LAGS + 1] = { 0 };
+	size_t i, run = 0;
+	unsigned int d, p, winner = 1;
+	int lead = 1;
+
+	for (p = 0; p < idx; p++) {
+		for (d = 1; d <= JENT_EST_LAGS; d++) {
+			score[d] += parts[p].score[d];
+			if (parts[p].last[d])
+				last[d] = parts[p].last[d];
+		}
+	}
+	for (d = 2; d <= JENT_EST_LAGS; d++) {
+		if (score[d] > score[winner] ||
+		    (score[d] && score[d] == score[winner] &&
+		     last[d] >= last[winner]))
+			winner = d;
+	}
+
+	part->correct = 0;
+	part->lead = 0;
+	part->maxrun = 0;
+	for (i = part->start; i < part->end; i++) {
+		/* lag winner is available once i >= winner */
+		if (i >= winner && sym[i - winner] == sym[i]) {
+			part->correct++;
+			if (++run > part->maxrun)
+				part->maxrun = run;
+			if (lead)
+				part->lead++;
+		} else {
+			run = 0;
+			lead = 0;
+		}
+
+		for (d = 1; d <= JENT_EST_LAGS && d <= i; d++) {
+			if (sym[i - d] != sym[i])
+				continue;
+			if (++score[d] >= score[winner])
+				winner = d;
+		}
+	}
+	part->run = run;
+}
+
+/* combine the @nr predicted ranges of @n symbols with @k distinct ones */
+double jent_est_lag_finish(const struct jent_est_lag_part *parts,
+			   unsigned int nr, size_t n, unsigned int k)
+{
+	size_t correct = 0, run = 0, maxrun = 0;
+	unsigned int p;
+
+	if (3 > n || !nr)
+		return -1;
+
+	for (p = 0; p < nr; p++) {
+		const struct jent_est_lag_part *part = &parts[p];
+
+		correct += part->correct;
+		if (part->maxrun > maxrun)
+			maxrun = part->maxrun;
+		/* runs continue across the range boundaries */
+		run += part->lead;
+		if (part->lead != part->end - part->start) {
+			if (run > maxrun)
+				maxrun = run;
+			run = part->run;
+		}
+	}
+	if (run > maxrun)
+		maxrun = run;
+
+	return jent_est_predictor(correct, n - 1, maxrun, k);
+}
+
+/*
+ * @sym: symbols
+ * @n: number of symbols
+ * @k: number of distinct symbols
+ */
+double jent_est_lag(const __u8 *sym, size_t n, unsigned int k)
+{
+	struct jent_est_lag_part part;
+
+	if (!jent_est_lag_split(n, 0, &part, 1))
+		return -1;
+	jent_est_lag_predict(sym, &part, 0);
+
+	return jent_est_lag_finish(&part, 1, n, k);
+}
@@ -0,0 +1,52 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Min-entropy estimators for the raw time deltas
+ *
+ * See jitterentropy-estimate.c for the license.
+ */
+
+#ifndef _JITTERENTROPY_ESTIMATE_H
+#define _JITTERENTROPY_ESTIMATE_H
+
+#include "jitterentropy.h"
+
+/* upper bound of the 99% confidence interval of a proportion */
+double jent_est_upper_bound(double p, size_t n);
+/* most common value estimate */
+double jent_est_mcv(const __u64 *samples, size_t n);
+
+/*
+ * SP 800-90B non-IID estimators on symbols of up to 8 bits and on bit
+ * strings holding one bit per byte, see jitterentropy-estimate.c
+ */
+double jent_est_mcv_sym(const __u8 *sym, size_t n);
+double jent_est_collision(const __u8 *bits, size_t n);
+double jent_est_markov(const __u8 *bits, size_t n);
+double jent_est_compression(const __u8 *bits, size_t n);
+int jent_est_tuple(const __u8 *sym, size_t n, double *t_tuple, double *lrs);
+double jent_est_multi_mcw(const __u8 *sym, size_t n, unsigned int k);
+double jent_est_lag(const __u8 *sym, size_t n, unsigned int k);
+
+/* lag prediction split into ranges of positions evaluated in parallel */
+#define JENT_EST_LAGS	128
+struct jent_est_lag_part {
+	size_t start;			/* first position of the range */
+	size_t end;			/* position after the range */
+	size_t score[JENT_EST_LAGS + 1]; /* matches per lag in the range */
+	size_t last[JENT_EST_LAGS + 1];	/* position + 1 of the last match */
+	size_t correct;			/* correct predictions */
+	size_t lead;			/* correct predictions at the start */
+	size_t run;			/* correct predictions at the end */
+	size_t maxrun;			/* longest run of correct predictions */
+};
+unsigned int jent_est_lag_split(size_t n, size_t min,
+				struct jent_est_lag_part *parts,
+				unsigned int nr);
+void jent_est_lag_count(const __u8 *sym, struct jent_est_lag_part *part);
+void jent_est_lag_predict(const __u8 *sym, struct jent_est_lag_part *parts,
+			  unsigned int idx);
+double jent_est_lag_finish(const struct jent_est_lag_part *parts,
+			   unsigned int nr, size_t n, unsigned int k);
+
+#endif /* _JITTERENTROPY_ESTIMATE_H */
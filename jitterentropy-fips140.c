@@ -0,0 +1,291 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * FIPS 140-2 statistical tests over the output
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * The statistical tests of FIPS 140-2 section 4.9.1 (the power-up tests
+ * that were removed with change notice 2, as implemented by rngtest) are
+ * applied to consecutive blocks of 20000 bits of the output. They cost a
+ * small fraction of the generation of the data: the monobit test counts
+ * bits 64 at a time, the poker test uses one table lookup per nibble and
+ * the runs tests process a whole byte per step using a table describing
+ * the runs within every byte value.
+ *
+ * Without -mpopcnt, the compiler implements __builtin_popcountll with a
+ * software routine. On x86, the monobit test is therefore also compiled
+ * for the population count instruction and that variant is selected at
+ * runtime when the CPU supports it.
+ *
+ * The bits of every byte are evaluated starting with the most significant
+ * bit.
+ */
+
+#include <pthread.h>
+
+#include "jitterentropy-fips140.h"
+
+/* Description of the runs within one byte, MSB first */
+struct jent_fips140_byte_runs {
+	unsigned char first_bit;	/* value of the leading run */
+	unsigned char first_len;	/* length of the leading run */
+	unsigned char last_bit;		/* value of the trailing run */
+	unsigned char last_len;		/* length of the trailing run */
+	/* runs neither leading nor trailing per bit value and length 1..6 */
+	unsigned char inner[2][7];
+};
+
+static struct jent_fips140_byte_runs jent_fips140_runs_table[256];
+static pthread_once_t jent_fips140_table_once = PTHREAD_ONCE_INIT;
+
+/* count the one bits of a block, 64 bits at a time */
+#define JENT_FIPS140_ONES(block, ones)					\
+	do {								\
+		unsigned int _i;					\
+									\
+		for (_i = 0; _i + 8 <= JENT_FIPS140_BLOCK_BYTES; _i += 8) { \
+			__u64 _w;					\
+									\
+			memcpy(&_w, (block) + _i, sizeof(_w));		\
+			(ones) += __builtin_popcountll(_w);		\
+		}							\
+		for (; _i < JENT_FIPS140_BLOCK_BYTES; _i++)		\
+			(ones) += __builtin_popcount((block)[_i]);	\
+	} while (0)
+
+static unsigned int jent_fips140_ones_generic(const unsigned char *block)
+{
+	unsigned int ones = 0;
+
+	JENT_FIPS140_ONES(block, ones);
+	return ones;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("popcnt")))
+static unsigned int jent_fips140_ones_popcnt(const unsigned char *block)
+{
+	unsigned int ones = 0;
+
+	JENT_FIPS140_ONES(block, ones);
+	return ones;
+}
+#endif
+
+static unsigned int (*jent_fips140_ones)(const unsigned char *block) =
+	jent_fips140_ones_generic;
+
+static void jent_fips140_init_table(void)
+{
+	unsigned int v;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("popcnt"))
+		jent_fips140_ones = jent_fips140_ones_popcnt;
+#endif
+
+	for (v = 0; v < 256; v++) {
+		struct jent_fips140_byte_runs *r = &jent_fips140_runs_table[v];
+		unsigned int bit = (v >> 7) & 1, len = 0, i, first = 1;
+
+		memset(r, 0, sizeof(*r));
+		for (i = 0; i < 8; i++) {
+			unsigned int b = (v >> (7 - i)) & 1;
+
+			if (b == bit) {
+				len++;
+				continue;
+			}
+			if (first) {
+				r->first_bit = bit;
+				r->first_len = len;
+				first = 0;
+			} else {
+				r->inner[bit][len]++;
+			}
+			bit = b;
+			len = 1;
+		}
+		if (first) {
+			r->first_bit = bit;
+			r->first_len = len;
+		}
+		r->last_bit = bit;
+		r->last_len = len;
+	}
+}
+
+void jent_fips140_init(struct jent_fips140 *st)
+{
+	memset(st, 0, sizeof(*st));
+}
+
+/* account a completed run */
+static inline void jent_fips140_run(unsigned int runs[2][7],
+				    unsigned int bit, unsigned int len,
+				    unsigned int *longest)
+{
+	if (len > *longest)
+		*longest = len;
+	runs[bit][(len > 6) ? 6 : len]++;
+}
+
+/*
+ * Test one block of JENT_FIPS140_BLOCK_BYTES.
+ *
+ * return: bit mask of the failed tests, 0 if all tests passed
+ */
+int jent_fips140_test_block(const unsigned char *block)
+{
+	/* FIPS 140-2 section 4.9.1 acceptance intervals for the runs test */
+	static const unsigned int runs_min[7] = { 0, 2315, 1114, 527, 240,
+						  103, 103 };
+	static const unsigned int runs_max[7] = { 0, 2685, 1386, 723, 384,
+						  209, 209 };
+	unsigned int poker[16];
+	unsigned int runs[2][7];
+	unsigned int ones = 0, longest = 0, cur_bit, cur_len = 0;
+	unsigned long poker_sum = 0;
+	unsigned int i, j;
+	int ret = 0;
+
+	pthread_once(&jent_fips140_table_once, jent_fips140_init_table);
+	memset(poker, 0, sizeof(poker));
+	memset(runs, 0, sizeof(runs));
+
+	/* monobit test */
+	ones = jent_fips140_ones(block);
+	if (ones <= 9725 || ones >= 10275)
+		ret |= JENT_FIPS140_MONOBIT;
+
+	/* poker test and runs tests */
+	cur_bit = (block[0] >> 7) & 1;
+	for (i = 0; i < JENT_FIPS140_BLOCK_BYTES; i++) {
+		const struct jent_fips140_byte_runs *r =
+			&jent_fips140_runs_table[block[i]];
+
+		poker[block[i] >> 4]++;
+		poker[block[i] & 0x0f]++;
+
+		if (r->first_bit == cur_bit) {
+			cur_len += r->first_len;
+		} else {
+			if (cur_len)
+				jent_fips140_run(runs, cur_bit, cur_len,
+						 &longest);
+			cur_bit = r->first_bit;
+			cur_len = r->first_len;
+		}
+		/* the run continues over the whole byte */
+		if (8 == r->first_len)
+			continue;
+
+		jent_fips140_run(runs, cur_bit, cur_len, &longest);
+		for (j = 1; j < 7; j++) {
+			runs[0][j] += r->inner[0][j];
+			runs[1][j] += r->inner[1][j];
+		}
+		cur_bit = r->last_bit;
+		cur_len = r->last_len;
+	}
+	jent_fips140_run(runs, cur_bit, cur_len, &longest);
+
+	for (i = 0; i < 16; i++)
+		poker_sum += (unsigned long)poker[i] * poker[i];
+	/* X = 16 / 5000 * sum - 5000 must be within 2.16 and 46.17, scaled
+	 * by 5000 / 16 to stay in integer arithmetic */
+	if (poker_sum * 16 <= 5000UL * 5000 + 10800 ||
+	    poker_sum * 16 >= 5000UL * 5000 + 230850)
+		ret |= JENT_FIPS140_POKER;
+
+	for (i = 0; i < 2; i++)
+		for (j = 1; j < 7; j++)
+			if (runs[i][j] < runs_min[j] || runs[i][j] > runs_max[j])
+				ret |= JENT_FIPS140_RUNS;
+
+	if (26 <= longest)
+		ret |= JENT_FIPS140_LONGRUN;
+
+	memset(poker, 0, sizeof(poker));
+	return ret;
+}
+
+/*
+ * Add data to the test state. Every completed block is tested right away
+ * and wiped afterwards.
+ *
+ * return: number of completed blocks that failed any test
+ */
+unsigned int jent_fips140_update(struct jent_fips140 *st,
+				 const unsigned char *buf, size_t len)
+{
+	unsigned int failed = 0;
+
+	while (len) {
+		size_t todo = JENT_FIPS140_BLOCK_BYTES - st->fill;
+		int ret;
+
+		if (todo > len)
+			todo = len;
+		memcpy(st->block + st->fill, buf, todo);
+		st->fill += todo;
+		buf += todo;
+		len -= todo;
+		if (JENT_FIPS140_BLOCK_BYTES > st->fill)
+			break;
+
+		ret = jent_fips140_test_block(st->block);
+		memset(st->block, 0, sizeof(st->block));
+		st->fill = 0;
+		st->blocks++;
+		st->last_result = ret;
+		if (!ret)
+			continue;
+		failed++;
+		st->failed_blocks++;
+		if (ret & JENT_FIPS140_MONOBIT)
+			st->fail_monobit++;
+		if (ret & JENT_FIPS140_POKER)
+			st->fail_poker++;
+		if (ret & JENT_FIPS140_RUNS)
+			st->fail_runs++;
+		if (ret & JENT_FIPS140_LONGRUN)
+			st->fail_longrun++;
+	}
+
+	return failed;
+}
@@ -0,0 +1,39 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * FIPS 140-2 statistical tests over the output
+ *
+ * See jitterentropy-fips140.c for the license.
+ */
+
+#ifndef _JITTERENTROPY_FIPS140_H
+#define _JITTERENTROPY_FIPS140_H
+
+#include "jitterentropy.h"
+
+#define JENT_FIPS140_BLOCK_BYTES 2500	/* 20000 bits */
+
+/* Results of the test of one block */
+#define JENT_FIPS140_MONOBIT	(1<<0)
+#define JENT_FIPS140_POKER	(1<<1)
+#define JENT_FIPS140_RUNS	(1<<2)
+#define JENT_FIPS140_LONGRUN	(1<<3)
+
+struct jent_fips140 {
+	unsigned char block[JENT_FIPS140_BLOCK_BYTES]; /* SENSITIVE */
+	unsigned int fill;		/* Bytes in ->block */
+	int last_result;		/* Result of the last tested block */
+	__u64 blocks;			/* Number of tested blocks */
+	__u64 failed_blocks;		/* Number of blocks failing any test */
+	__u64 fail_monobit;		/* Failures per test */
+	__u64 fail_poker;
+	__u64 fail_runs;
+	__u64 fail_longrun;
+};
+
+void jent_fips140_init(struct jent_fips140 *st);
+int jent_fips140_test_block(const unsigned char *block);
+unsigned int jent_fips140_update(struct jent_fips140 *st,
+				 const unsigned char *buf, size_t len);
+
+#endif /* _JITTERENTROPY_FIPS140_H */
@@ -0,0 +1,137 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Deterministic mock clock for benchmarks of the post-processing
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * When jitterentropy-base.c is compiled with JENT_MOCK_CLOCK, every time
+ * stamp comes from jent_mock_nstime instead of the system clock. The mock
+ * clock advances by one delta per read. The deltas either follow a seeded
+ * pseudo-random model with a given mean and standard deviation or are
+ * replayed from a recorded capture, starting over at its end.
+ *
+ * With the timer taken out, the entropy collector performs exactly the
+ * same work on every run: Von-Neuman unbias, stirring, the FIPS test and
+ * the output buffering become deterministic and can be benchmarked and
+ * compared bit for bit. The mock clock provides no entropy whatsoever and
+ * must never be linked into anything but benchmarks. It is not thread
+ * safe.
+ */
+
+#include "jitterentropy.h"
+#include "jitterentropy-mock.h"
+
+static struct {
+	__u64 now;
+	__u64 state;		/* xorshift64* state of the model */
+	__u64 mean;
+	__u64 sd;
+	const __u64 *deltas;	/* replayed deltas, NULL for the model */
+	size_t nr_deltas;
+	size_t pos;
+	__u64 reads;
+} Mock = {
+	/* a non-zero seconds part like a real time stamp */
+	.now = 1ULL << 32,
+	.state = 1,
+	.mean = 1000,
+	.sd = 30,
+};
+
+static __u64 jent_mock_random(void)
+{
+	Mock.state ^= Mock.state >> 12;
+	Mock.state ^= Mock.state << 25;
+	Mock.state ^= Mock.state >> 27;
+	return Mock.state * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * Use the pseudo-random delta model: the sum of four uniform variables
+ * scaled to @sd around @mean, which is close enough to a normal
+ * distribution for the health tests and the unbias.
+ */
+void jent_mock_clock_model(__u64 seed, __u64 mean, __u64 sd)
+{
+	Mock.now = 1ULL << 32;
+	Mock.state = seed ? seed : 1;
+	Mock.mean = mean;
+	Mock.sd = sd;
+	Mock.deltas = NULL;
+	Mock.nr_deltas = 0;
+	Mock.reads = 0;
+}
+
+/* replay @deltas, the caller keeps the buffer until the clock is reset */
+void jent_mock_clock_replay(const __u64 *deltas, size_t n)
+{
+	Mock.now = 1ULL << 32;
+	Mock.deltas = n ? deltas : NULL;
+	Mock.nr_deltas = n;
+	Mock.pos = 0;
+	Mock.reads = 0;
+}
+
+/* number of time stamps taken since the clock was set up */
+__u64 jent_mock_clock_reads(void)
+{
+	return Mock.reads;
+}
+
+void jent_mock_nstime(__u64 *out)
+{
+	__u64 delta;
+
+	if (Mock.deltas) {
+		delta = Mock.deltas[Mock.pos++];
+		if (Mock.pos == Mock.nr_deltas)
+			Mock.pos = 0;
+	} else {
+		/* each uniform spans [-sd * sqrt(3) / 2, sd * sqrt(3) / 2) */
+		double noise = 0;
+		int i;
+
+		for (i = 0; i < 4; i++)
+			noise += (double)(jent_mock_random() >> 11) /
+				 (1ULL << 53) - 0.5;
+		noise *= 1.7320508 * Mock.sd;
+		delta = ((double)Mock.mean + noise < 1) ? 1 :
+			(__u64)((double)Mock.mean + noise);
+	}
+	Mock.now += delta;
+	Mock.reads++;
+	*out = Mock.now;
+}
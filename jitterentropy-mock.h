@@ -0,0 +1,20 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Deterministic mock clock for benchmarks of the post-processing
+ *
+ * See jitterentropy-mock.c for the license.
+ */
+
+#ifndef _JITTERENTROPY_MOCK_H
+#define _JITTERENTROPY_MOCK_H
+
+#include "jitterentropy.h"
+
+void jent_mock_clock_model(__u64 seed, __u64 mean, __u64 sd);
+void jent_mock_clock_replay(const __u64 *deltas, size_t n);
+__u64 jent_mock_clock_reads(void);
+/* jent_get_nstime of a base compiled with JENT_MOCK_CLOCK */
+void jent_mock_nstime(__u64 *out);
+
+#endif /* _JITTERENTROPY_MOCK_H */
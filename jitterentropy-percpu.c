@@ -0,0 +1,184 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Per-CPU sharded entropy collectors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Applications with many threads which only occasionally need random
+ * numbers waste memory and initialization time when each thread holds its
+ * own entropy collector. The per-CPU mode keeps one entropy collector per
+ * CPU instead. A caller uses the collector of the CPU it currently runs on
+ * as reported by sched_getcpu. If that collector is in use by a thread that
+ * was preempted or migrated, the collectors of the following CPUs are tried
+ * before waiting for the own one.
+ *
+ * The entropy collector of a CPU is only allocated when it is used for the
+ * first time. Thus, the cost scales with the number of CPUs that actually
+ * request random numbers.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <pthread.h>
+
+#include "jitterentropy.h"
+
+/* Number of neighboring shards that are tried before waiting */
+#define JENT_PERCPU_PROBES 4
+/* Cache line size the shards are aligned to */
+#define JENT_PERCPU_ALIGN 64
+
+/* every shard occupies its own cache lines: the alignment pads the size of
+ * the struct and the shard array is allocated with that alignment */
+struct jent_percpu_shard {
+	pthread_mutex_t lock;
+	struct rand_data *ec;	/* allocated on first use */
+} __attribute__((aligned(JENT_PERCPU_ALIGN)));
+
+struct jent_percpu {
+	unsigned int osr;
+	unsigned int flags;
+	unsigned int nr_shards;
+	struct jent_percpu_shard *shards;
+};
+
+/*
+ * Allocate the per-CPU entropy collectors.
+ *
+ * jent_entropy_init must have been called successfully before.
+ *
+ * @osr: oversampling rate used for all entropy collectors
+ * @flags: flags used for all entropy collectors
+ *
+ * return: per-CPU instance or NULL on error
+ */
+struct jent_percpu *jent_percpu_alloc(unsigned int osr, unsigned int flags)
+{
+	struct jent_percpu *pc;
+	long cpus = sysconf(_SC_NPROCESSORS_CONF);
+	unsigned int i;
+
+	if (1 > cpus)
+		cpus = 1;
+
+	pc = jent_zalloc(sizeof(struct jent_percpu));
+	if (NULL == pc)
+		return NULL;
+	/* the shards hold no sensitive data, they only refer to the entropy
+	 * collectors, so the aligned allocation needs no secure memory */
+	if (posix_memalign((void **)&pc->shards, JENT_PERCPU_ALIGN,
+			   cpus * sizeof(struct jent_percpu_shard))) {
+		jent_zfree(pc, sizeof(struct jent_percpu));
+		return NULL;
+	}
+	memset(pc->shards, 0, cpus * sizeof(struct jent_percpu_shard));
+	pc->osr = osr;
+	pc->flags = flags;
+	pc->nr_shards = cpus;
+	for (i = 0; i < pc->nr_shards; i++)
+		pthread_mutex_init(&pc->shards[i].lock, NULL);
+
+	return pc;
+}
+
+void jent_percpu_free(struct jent_percpu *pc)
+{
+	unsigned int i;
+
+	if (NULL == pc)
+		return;
+	for (i = 0; i < pc->nr_shards; i++) {
+		if (NULL != pc->shards[i].ec)
+			jent_entropy_collector_free(pc->shards[i].ec);
+		pthread_mutex_destroy(&pc->shards[i].lock);
+	}
+	free(pc->shards);
+	jent_zfree(pc, sizeof(struct jent_percpu));
+}
+
+/*
+ * Find and lock the shard to be used by the caller: try the shard of the
+ * current CPU and its neighbors without blocking, then wait for the shard
+ * of the current CPU.
+ */
+static struct jent_percpu_shard *jent_percpu_lock(struct jent_percpu *pc)
+{
+	struct jent_percpu_shard *shard;
+	int cpu = sched_getcpu();
+	unsigned int i;
+
+	if (0 > cpu)
+		cpu = 0;
+
+	for (i = 0; i < JENT_PERCPU_PROBES && i < pc->nr_shards; i++) {
+		shard = &pc->shards[(cpu + i) % pc->nr_shards];
+		if (!pthread_mutex_trylock(&shard->lock))
+			return shard;
+	}
+
+	shard = &pc->shards[cpu % pc->nr_shards];
+	pthread_mutex_lock(&shard->lock);
+	return shard;
+}
+
+/*
+ * Obtain entropy from the entropy collector of the current CPU.
+ *
+ * return: number of bytes returned when request is fulfilled or an error
+ *
+ * The following error codes can occur in addition to the ones of
+ * jent_read_entropy:
+ *	-3	allocation of the entropy collector failed
+ */
+int jent_percpu_read_entropy(struct jent_percpu *pc, char *data, size_t len)
+{
+	struct jent_percpu_shard *shard;
+	int ret;
+
+	if (NULL == pc)
+		return -2;
+
+	shard = jent_percpu_lock(pc);
+	if (NULL == shard->ec)
+		shard->ec = jent_entropy_collector_alloc(pc->osr, pc->flags);
+	if (NULL == shard->ec)
+		ret = -3;
+	else
+		ret = jent_read_entropy(shard->ec, data, len);
+	pthread_mutex_unlock(&shard->lock);
+
+	return ret;
+}
@@ -0,0 +1,301 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Refill latency benchmark of the jitterentropy-rngd scheduling
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * jent-rngd-bench runs the scheduling and injection logic of the daemon
+ * against a simulated input_pool drained in a steady, bursty or boot storm
+ * pattern. For each daemon configuration it reports the distribution of
+ * the refill latency -- the time from the pool dropping to the refill
+ * threshold until credited entropy is injected -- together with the time
+ * spent at or below the threshold and the CPU cost. Unless given, the
+ * collector throughput and CPU cost are measured on this host first.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "jitterentropy.h"
+#include "jitterentropy-rngd-sched.h"
+
+#define MAX_CONFIGS 64
+#define MAX_LATENCIES (1 << 20)
+#define MEASURE_BYTES (16 * RNGD_SCHED_BATCH)
+
+static struct rngd_sched Configs[MAX_CONFIGS];
+static unsigned int Nr_configs = 0;
+static struct rngd_sim_model Model;
+static double Rate = 256;
+static unsigned int Duration = 600;
+static int Pattern = -1;
+
+/* default configurations: the daemon default and its neighbours */
+static const struct rngd_sched Default_configs[] = {
+	{ RNGD_SCHED_THRESHOLD, RNGD_SCHED_BATCH, RNGD_SCHED_INTERVAL },
+	{ RNGD_SCHED_THRESHOLD, RNGD_SCHED_BATCH, 1 },
+	{ RNGD_SCHED_THRESHOLD, 64, RNGD_SCHED_INTERVAL },
+	{ RNGD_SCHED_THRESHOLD, 1024, RNGD_SCHED_INTERVAL },
+	{ 2048, RNGD_SCHED_BATCH, RNGD_SCHED_INTERVAL },
+	{ 2048, 1024, 1 },
+	{ 512, RNGD_SCHED_BATCH, RNGD_SCHED_INTERVAL },
+};
+
+static __u64 clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Measure throughput and CPU cost of one entropy collector. Only the
+ * quantities not given on the command line (still negative) are set.
+ */
+static int measure_collector(void)
+{
+	struct rand_data *ec = NULL;
+	char buf[RNGD_SCHED_BATCH];
+	__u64 start, cpu;
+	unsigned int i;
+	int ret = jent_entropy_init();
+
+	if (ret) {
+		fprintf(stderr, "The initialization of CPU Jitter RNG failed with error code %d\n", ret);
+		return -EFAULT;
+	}
+	ec = jent_entropy_collector_alloc(1, 0);
+	if (!ec)
+		return -ENOMEM;
+
+	start = clock_ns(CLOCK_MONOTONIC);
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+	for (i = 0; i < MEASURE_BYTES / sizeof(buf); i++) {
+		if (0 > jent_read_entropy(ec, buf, sizeof(buf))) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	start = clock_ns(CLOCK_MONOTONIC) - start;
+	memset(buf, 0, sizeof(buf));
+	jent_entropy_collector_free(ec);
+	if (ret)
+		return ret;
+
+	if (0 > Model.throughput)
+		Model.throughput = MEASURE_BYTES * 1e9 / start;
+	if (0 > Model.cpu_per_byte)
+		Model.cpu_per_byte = cpu / 1e9 / MEASURE_BYTES;
+	return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	__u64 x = *(const __u64 *)a;
+	__u64 y = *(const __u64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile(const __u64 *lat, size_t n, unsigned int pct)
+{
+	if (!n)
+		return 0;
+	return lat[(n - 1) * pct / 100] / 1e6;
+}
+
+static void run_pattern(enum rngd_pattern pattern, __u64 *lat)
+{
+	struct rngd_demand *demand = NULL;
+	struct rngd_sim_latency latency = { .lat = lat, .max = MAX_LATENCIES };
+	size_t nr = 0;
+	unsigned int i;
+
+	if (rngd_demand_pattern(pattern, Rate, Duration * 1000000000ULL,
+				&demand, &nr))
+		return;
+
+	printf("\nPattern %s, %.0f bits/s drain, %u s\n",
+	       rngd_pattern_name(pattern), Rate, Duration);
+	printf("threshold  batch interval  p50[ms]  p90[ms]  p99[ms]  max[ms]  below[%%]   refills    cpu[s]\n");
+	for (i = 0; i < Nr_configs; i++) {
+		struct rngd_sim_result res;
+
+		if (rngd_sim_run(&Configs[i], &Model, demand, nr, &res,
+				 &latency))
+			continue;
+		qsort(lat, latency.nr, sizeof(__u64), cmp_u64);
+		printf("%9u %6u %8u %8.1f %8.1f %8.1f %8.1f %9.3f %9llu %9.3f\n",
+		       Configs[i].threshold, Configs[i].batch,
+		       Configs[i].interval,
+		       percentile(lat, latency.nr, 50),
+		       percentile(lat, latency.nr, 90),
+		       percentile(lat, latency.nr, 99),
+		       percentile(lat, latency.nr, 100),
+		       100.0 * res.below / res.duration, res.refills, res.cpu);
+		if (latency.lost)
+			printf("\t(%zu latencies not recorded)\n", latency.lost);
+	}
+	free(demand);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "\nRefill latency benchmark of the jitterentropy-rngd scheduling\n\n");
+	fprintf(stderr, "Usage: jent-rngd-bench [options]\n");
+	fprintf(stderr, "\t-c\tConfiguration threshold:batch:interval, may be given\n");
+	fprintf(stderr, "\t\tup to %d times (default: a set around the daemon default)\n",
+		MAX_CONFIGS);
+	fprintf(stderr, "\t-p\tDrain pattern steady, bursty or boot (default: all)\n");
+	fprintf(stderr, "\t-D\tMean drain in bits per second (default 256)\n");
+	fprintf(stderr, "\t-d\tSimulated duration in seconds (default 600)\n");
+	fprintf(stderr, "\t-r\tCollector throughput in bytes per second\n");
+	fprintf(stderr, "\t\t(default: measured)\n");
+	fprintf(stderr, "\t-u\tCPU nanoseconds per byte gathered (default: measured)\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	int c = 0;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"config", 1, 0, 'c'},
+			{"pattern", 1, 0, 'p'},
+			{"drain", 1, 0, 'D'},
+			{"duration", 1, 0, 'd'},
+			{"throughput", 1, 0, 'r'},
+			{"cpu", 1, 0, 'u'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "c:p:D:d:r:u:", opts, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'c': {
+			struct rngd_sched *sched = &Configs[Nr_configs];
+
+			if (MAX_CONFIGS <= Nr_configs ||
+			    3 != sscanf(optarg, "%u:%u:%u", &sched->threshold,
+					&sched->batch, &sched->interval) ||
+			    !sched->batch ||
+			    RNGD_SCHED_MAX_BATCH < sched->batch ||
+			    !sched->interval)
+				usage();
+			Nr_configs++;
+			break;
+		}
+		case 'p':
+			if (!strcmp(optarg, "steady"))
+				Pattern = RNGD_PATTERN_STEADY;
+			else if (!strcmp(optarg, "bursty"))
+				Pattern = RNGD_PATTERN_BURSTY;
+			else if (!strcmp(optarg, "boot"))
+				Pattern = RNGD_PATTERN_BOOT;
+			else
+				usage();
+			break;
+		case 'D':
+			Rate = strtod(optarg, NULL);
+			if (0 > Rate)
+				usage();
+			break;
+		case 'd':
+			Duration = strtoul(optarg, NULL, 10);
+			if (!Duration)
+				usage();
+			break;
+		case 'r':
+			Model.throughput = strtod(optarg, NULL);
+			if (0 >= Model.throughput)
+				usage();
+			break;
+		case 'u':
+			Model.cpu_per_byte = strtod(optarg, NULL) / 1e9;
+			if (0 > Model.cpu_per_byte)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+}
+
+int main(int argc, char *argv[])
+{
+	__u64 *lat = NULL;
+	unsigned int i;
+
+	rngd_sim_model_init(&Model);
+	/* measured unless given on the command line */
+	Model.throughput = -1;
+	Model.cpu_per_byte = -1;
+	parse_opts(argc, argv);
+	if (!Nr_configs) {
+		for (i = 0; i < sizeof(Default_configs) /
+				sizeof(Default_configs[0]); i++)
+			Configs[Nr_configs++] = Default_configs[i];
+	}
+	if ((0 > Model.throughput || 0 > Model.cpu_per_byte) &&
+	    measure_collector())
+		return 1;
+
+	lat = malloc(MAX_LATENCIES * sizeof(__u64));
+	if (!lat)
+		return 1;
+
+	printf("Collectors:\t%.0f bytes/s, %.0f CPU ns/byte\n", Model.throughput,
+	       Model.cpu_per_byte * 1e9);
+	printf("Pool:\t\t%u bits, write wakeup threshold %u bits\n",
+	       Model.pool_size, Model.wakeup);
+	for (i = 0; i < RNGD_PATTERN_MAX; i++) {
+		if (0 > Pattern || (int)i == Pattern)
+			run_pattern(i, lat);
+	}
+	free(lat);
+
+	return 0;
+}
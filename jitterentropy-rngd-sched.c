@@ -0,0 +1,414 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Scheduling logic of jitterentropy-rngd, demand traces and simulation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * The decision when and how much entropy the daemon injects is kept apart
+ * from the daemon so that it can be replayed offline. The daemon records
+ * its wakeups with the entropy_avail it found in a trace. The simulator
+ * derives the demand of the kernel from such a trace and replays it
+ * against the same scheduling logic with a modelled collector throughput
+ * and a simulated input_pool standing in for /dev/random.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "jitterentropy-rngd-sched.h"
+
+void rngd_sched_init(struct rngd_sched *sched)
+{
+	sched->threshold = RNGD_SCHED_THRESHOLD;
+	sched->batch = RNGD_SCHED_BATCH;
+	sched->interval = RNGD_SCHED_INTERVAL;
+}
+
+/*
+ * Decide how much entropy to inject on a wakeup. The kernel only signals
+ * /dev/random as writable when it wants entropy; the periodic check covers
+ * the drain via get_random_bytes which does not wake up writers.
+ *
+ * return: number of bytes to inject
+ */
+size_t rngd_sched_decide(const struct rngd_sched *sched,
+			 enum rngd_wakeup wakeup, int entropy_avail)
+{
+	if (RNGD_WAKEUP_ALARM == wakeup &&
+	    entropy_avail > (int)sched->threshold)
+		return 0;
+	return sched->batch;
+}
+
+static const char *rngd_wakeup_name[] = {
+	[RNGD_WAKEUP_START] = "start",
+	[RNGD_WAKEUP_POLL] = "poll",
+	[RNGD_WAKEUP_ALARM] = "alarm",
+};
+
+int rngd_trace_write(FILE *f, const struct rngd_trace_event *ev)
+{
+	if (0 > fprintf(f, "%llu %s %d %u %u %llu %llu\n",
+			(unsigned long long)ev->time,
+			rngd_wakeup_name[ev->wakeup], ev->avail, ev->bytes,
+			ev->credited, (unsigned long long)ev->gather,
+			(unsigned long long)ev->cpu))
+		return -EIO;
+	return 0;
+}
+
+/*
+ * Read the next event of a trace.
+ *
+ * return: 1 if an event was read, 0 at the end of the trace, < 0 on error
+ */
+int rngd_trace_read(FILE *f, struct rngd_trace_event *ev)
+{
+	char line[256], wakeup[16];
+	unsigned long long time, gather, cpu;
+	unsigned int i;
+
+	while (fgets(line, sizeof(line), f)) {
+		if ('#' == line[0] || '\n' == line[0])
+			continue;
+		if (7 != sscanf(line, "%llu %15s %d %u %u %llu %llu", &time,
+				wakeup, &ev->avail, &ev->bytes, &ev->credited,
+				&gather, &cpu))
+			return -EINVAL;
+		for (i = 0; i <= RNGD_WAKEUP_ALARM; i++) {
+			if (!strcmp(wakeup, rngd_wakeup_name[i]))
+				break;
+		}
+		if (i > RNGD_WAKEUP_ALARM)
+			return -EINVAL;
+		ev->wakeup = i;
+		ev->time = time;
+		ev->gather = gather;
+		ev->cpu = cpu;
+		return 1;
+	}
+
+	return ferror(f) ? -EIO : 0;
+}
+
+void rngd_pool_init(struct rngd_pool *pool, unsigned int size,
+		    unsigned int wakeup, double level)
+{
+	pool->size = size;
+	pool->wakeup = wakeup;
+	pool->level = (level > size) ? size : level;
+}
+
+void rngd_pool_drain(struct rngd_pool *pool, double bits)
+{
+	pool->level -= bits;
+	if (pool->level < 0)
+		pool->level = 0;
+	else if (pool->level > pool->size)
+		pool->level = pool->size;
+}
+
+void rngd_pool_credit(struct rngd_pool *pool, double bits)
+{
+	rngd_pool_drain(pool, -bits);
+}
+
+/*
+ * Derive the demand on the pool from a trace: between two events with a
+ * known entropy_avail, the pool lost what it had plus what the daemon
+ * credited minus what was left. Sources other than the daemon show up as
+ * negative drain.
+ *
+ * @f: trace
+ * @pool_size: capacity of the pool, limits the credited entropy
+ * @demand: allocated demand segments, to be freed by the caller
+ * @nr: number of demand segments
+ * @throughput: bytes per second gathered by the daemon, 0 if the trace has
+ *		no injection
+ * @cpu_per_byte: CPU seconds per byte gathered
+ *
+ * return: 0 on success, < 0 on error
+ */
+int rngd_demand_from_trace(FILE *f, unsigned int pool_size,
+			   struct rngd_demand **demand, size_t *nr,
+			   double *throughput, double *cpu_per_byte)
+{
+	struct rngd_trace_event ev, prev;
+	struct rngd_demand *d = NULL;
+	size_t n = 0, alloced = 0;
+	double bytes = 0, gather = 0, cpu = 0;
+	int have_prev = 0, ret;
+
+	while (0 < (ret = rngd_trace_read(f, &ev))) {
+		bytes += ev.bytes;
+		gather += ev.gather;
+		cpu += ev.cpu;
+		if (0 > ev.avail)
+			continue;
+
+		if (have_prev && ev.time > prev.time) {
+			double before = prev.avail + prev.credited;
+
+			if (before > pool_size)
+				before = pool_size;
+			if (n == alloced) {
+				struct rngd_demand *tmp;
+
+				alloced = alloced ? 2 * alloced : 1024;
+				tmp = realloc(d, alloced * sizeof(*d));
+				if (NULL == tmp) {
+					ret = -ENOMEM;
+					break;
+				}
+				d = tmp;
+			}
+			d[n].duration = ev.time - prev.time;
+			d[n].rate = (before - ev.avail) * 1e9 /
+				    (double)d[n].duration;
+			n++;
+		}
+		prev = ev;
+		have_prev = 1;
+	}
+	if (ret) {
+		free(d);
+		return ret;
+	}
+
+	*demand = d;
+	*nr = n;
+	*throughput = gather ? bytes * 1e9 / gather : 0;
+	*cpu_per_byte = bytes ? cpu / 1e9 / bytes : 0;
+	return 0;
+}
+
+static const char *rngd_pattern_names[RNGD_PATTERN_MAX] = {
+	[RNGD_PATTERN_STEADY] = "steady",
+	[RNGD_PATTERN_BURSTY] = "bursty",
+	[RNGD_PATTERN_BOOT] = "boot storm",
+};
+
+const char *rngd_pattern_name(enum rngd_pattern pattern)
+{
+	return (pattern < RNGD_PATTERN_MAX) ? rngd_pattern_names[pattern] : "";
+}
+
+#define RNGD_NS			1000000000ULL
+/* bursty: 8 times the mean for 1 of 10 seconds, the rest keeps the mean */
+#define RNGD_BURST_PERIOD	10
+#define RNGD_BURST_FACTOR	8
+/* boot storm: 20 times the mean during the first 30 seconds */
+#define RNGD_BOOT_TIME		30
+#define RNGD_BOOT_FACTOR	20
+
+/*
+ * Generate a synthetic demand of @duration ns with a drain of @rate bits
+ * per second in steady state.
+ *
+ * return: 0 on success, < 0 on error
+ */
+int rngd_demand_pattern(enum rngd_pattern pattern, double rate,
+			__u64 duration, struct rngd_demand **demand,
+			size_t *nr)
+{
+	struct rngd_demand *d = NULL;
+	size_t n = 0, max;
+	__u64 t = 0;
+
+	if (pattern >= RNGD_PATTERN_MAX || !duration)
+		return -EINVAL;
+
+	/* one segment per second at most */
+	max = duration / RNGD_NS + 2;
+	d = calloc(max, sizeof(*d));
+	if (NULL == d)
+		return -ENOMEM;
+
+	switch (pattern) {
+	case RNGD_PATTERN_STEADY:
+		d[n].duration = duration;
+		d[n++].rate = rate;
+		break;
+	case RNGD_PATTERN_BURSTY:
+		while (t < duration) {
+			int burst = !((t / RNGD_NS) % RNGD_BURST_PERIOD);
+
+			d[n].duration = RNGD_NS;
+			d[n++].rate = burst ? RNGD_BURST_FACTOR * rate :
+				rate * (RNGD_BURST_PERIOD - RNGD_BURST_FACTOR) /
+				(RNGD_BURST_PERIOD - 1);
+			t += RNGD_NS;
+		}
+		break;
+	case RNGD_PATTERN_BOOT:
+		d[n].duration = RNGD_BOOT_TIME * RNGD_NS;
+		if (d[n].duration > duration)
+			d[n].duration = duration;
+		d[n++].rate = RNGD_BOOT_FACTOR * rate;
+		if (duration > RNGD_BOOT_TIME * RNGD_NS) {
+			d[n].duration = duration - RNGD_BOOT_TIME * RNGD_NS;
+			d[n++].rate = rate;
+		}
+		break;
+	default:
+		break;
+	}
+
+	*demand = d;
+	*nr = n;
+	return 0;
+}
+
+void rngd_sim_model_init(struct rngd_sim_model *model)
+{
+	model->throughput = 0;
+	model->cpu_per_byte = 0;
+	model->pool_size = RNGD_POOL_SIZE;
+	model->wakeup = RNGD_POOL_WAKEUP;
+	model->level = RNGD_POOL_SIZE;
+	model->step = 1000000;
+}
+
+/*
+ * Replay a demand against the scheduling logic of the daemon.
+ *
+ * The daemon either waits for a wakeup or gathers one batch which takes
+ * batch / throughput seconds and is credited when complete. While it
+ * waits, the kernel wakes it up as soon as the pool drops below the
+ * write_wakeup_threshold and the alarm fires every interval seconds after
+ * the last check, like alarm() being re-armed by the daemon.
+ *
+ * @latency: records the refill latencies if not NULL
+ *
+ * return: 0 on success, < 0 on error
+ */
+int rngd_sim_run(const struct rngd_sched *sched,
+		 const struct rngd_sim_model *model,
+		 const struct rngd_demand *demand, size_t nr,
+		 struct rngd_sim_result *result,
+		 struct rngd_sim_latency *latency)
+{
+	struct rngd_pool pool;
+	__u64 t = 0, seg_end = 0, done = 0, next_alarm;
+	/* time the pool dropped to the threshold, 0 if above */
+	__u64 dip = 0;
+	__u64 step = model->step;
+	size_t seg = 0;
+	size_t gathering = 0;
+	double cpu_ratio;
+
+	memset(result, 0, sizeof(*result));
+	if (latency) {
+		latency->nr = 0;
+		latency->lost = 0;
+	}
+	if (!nr || !step || 0 >= model->throughput || !sched->batch)
+		return -EINVAL;
+
+	/* share of one CPU used while gathering */
+	cpu_ratio = model->cpu_per_byte * model->throughput;
+	rngd_pool_init(&pool, model->pool_size, model->wakeup, model->level);
+	next_alarm = (__u64)sched->interval * 1000000000ULL;
+	seg_end = demand[0].duration;
+
+	/* the daemon seeds the pool when it starts */
+	gathering = rngd_sched_decide(sched, RNGD_WAKEUP_START, pool.level);
+	done = (__u64)(gathering * 1e9 / model->throughput);
+	result->wakeups++;
+
+	while (seg < nr) {
+		rngd_pool_drain(&pool, demand[seg].rate * step / 1e9);
+
+		if (gathering) {
+			result->cpu += cpu_ratio * step / 1e9;
+			if (t >= done) {
+				rngd_pool_credit(&pool, gathering * 8);
+				result->bytes += gathering;
+				result->refills++;
+				gathering = 0;
+				if (dip && latency) {
+					if (latency->nr < latency->max)
+						latency->lat[latency->nr++] =
+							t + 1 - dip;
+					else
+						latency->lost++;
+				}
+				dip = 0;
+			}
+		}
+		if (!gathering) {
+			enum rngd_wakeup wakeup = RNGD_WAKEUP_POLL;
+			int avail = (int)pool.level;
+			int wake = 0;
+
+			if (avail < (int)pool.wakeup) {
+				wake = 1;
+			} else if (t >= next_alarm) {
+				wakeup = RNGD_WAKEUP_ALARM;
+				next_alarm = t + (__u64)sched->interval *
+						 1000000000ULL;
+				wake = 1;
+			}
+			if (wake) {
+				result->wakeups++;
+				gathering = rngd_sched_decide(sched, wakeup,
+							      avail);
+				done = t + (__u64)(gathering * 1e9 /
+						   model->throughput);
+			}
+		}
+
+		if (pool.level <= sched->threshold) {
+			result->below += step;
+			/* t + 1 keeps a dip at time 0 distinguishable */
+			if (!dip)
+				dip = t + 1;
+		}
+		if (pool.level < 1)
+			result->empty += step;
+
+		t += step;
+		while (seg < nr && t >= seg_end) {
+			seg++;
+			if (seg < nr)
+				seg_end += demand[seg].duration;
+		}
+	}
+	result->duration = t;
+
+	return 0;
+}
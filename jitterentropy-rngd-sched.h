@@ -0,0 +1,140 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Scheduling logic of jitterentropy-rngd, demand traces and simulation
+ *
+ * See jitterentropy-rngd-sched.c for the license.
+ */
+
+#ifndef _JITTERENTROPY_RNGD_SCHED_H
+#define _JITTERENTROPY_RNGD_SCHED_H
+
+#include <stdio.h>
+#include <asm/types.h>
+
+/* Scheduling parameters of the daemon */
+struct rngd_sched {
+	unsigned int threshold;	/* refill on alarm if entropy_avail is at
+				 * or below this number of bits */
+	unsigned int batch;	/* bytes injected per refill */
+	unsigned int interval;	/* seconds between checks of entropy_avail */
+};
+
+#define RNGD_SCHED_THRESHOLD	1024
+#define RNGD_SCHED_BATCH	256
+#define RNGD_SCHED_MAX_BATCH	4096
+#define RNGD_SCHED_INTERVAL	5
+
+/* Reason for the daemon to wake up */
+enum rngd_wakeup {
+	RNGD_WAKEUP_START,	/* initial seeding */
+	RNGD_WAKEUP_POLL,	/* /dev/random signalled it is writable */
+	RNGD_WAKEUP_ALARM,	/* periodic check of entropy_avail */
+};
+
+void rngd_sched_init(struct rngd_sched *sched);
+size_t rngd_sched_decide(const struct rngd_sched *sched,
+			 enum rngd_wakeup wakeup, int entropy_avail);
+
+/*
+ * Trace of the wakeups of the daemon, one event per line:
+ *	<time> <wakeup> <avail> <bytes> <credited> <gather> <cpu>
+ * time:	nanoseconds since the start of the trace
+ * wakeup:	start, poll or alarm
+ * avail:	entropy_avail in bits before the injection, -1 if unknown
+ * bytes:	bytes injected
+ * credited:	bits of entropy credited
+ * gather:	nanoseconds spent gathering and injecting
+ * cpu:		CPU time of the process in nanoseconds spent doing so
+ * Lines starting with # are comments.
+ */
+struct rngd_trace_event {
+	__u64 time;
+	enum rngd_wakeup wakeup;
+	int avail;
+	unsigned int bytes;
+	unsigned int credited;
+	__u64 gather;
+	__u64 cpu;
+};
+
+int rngd_trace_write(FILE *f, const struct rngd_trace_event *ev);
+int rngd_trace_read(FILE *f, struct rngd_trace_event *ev);
+
+/* Simulated input_pool of the kernel */
+struct rngd_pool {
+	double level;		/* entropy in bits */
+	unsigned int size;	/* capacity in bits */
+	unsigned int wakeup;	/* write_wakeup_threshold in bits */
+};
+
+#define RNGD_POOL_SIZE		4096
+#define RNGD_POOL_WAKEUP	896
+
+void rngd_pool_init(struct rngd_pool *pool, unsigned int size,
+		    unsigned int wakeup, double level);
+void rngd_pool_drain(struct rngd_pool *pool, double bits);
+void rngd_pool_credit(struct rngd_pool *pool, double bits);
+
+/* Demand on the pool: net drain of @rate bits per second for @duration ns */
+struct rngd_demand {
+	__u64 duration;
+	double rate;
+};
+
+int rngd_demand_from_trace(FILE *f, unsigned int pool_size,
+			   struct rngd_demand **demand, size_t *nr,
+			   double *throughput, double *cpu_per_byte);
+
+/* Synthetic demand patterns */
+enum rngd_pattern {
+	RNGD_PATTERN_STEADY,	/* constant drain */
+	RNGD_PATTERN_BURSTY,	/* low drain with periodic bursts */
+	RNGD_PATTERN_BOOT,	/* heavy drain after boot, then steady */
+	RNGD_PATTERN_MAX
+};
+
+const char *rngd_pattern_name(enum rngd_pattern pattern);
+int rngd_demand_pattern(enum rngd_pattern pattern, double rate,
+			__u64 duration, struct rngd_demand **demand,
+			size_t *nr);
+
+/* Model of the collectors and the kernel for the simulation */
+struct rngd_sim_model {
+	double throughput;	/* bytes per second gathered */
+	double cpu_per_byte;	/* CPU seconds per byte gathered */
+	unsigned int pool_size;	/* bits */
+	unsigned int wakeup;	/* write_wakeup_threshold in bits */
+	double level;		/* initial entropy in bits */
+	__u64 step;		/* simulation step in ns */
+};
+
+struct rngd_sim_result {
+	__u64 duration;		/* simulated time in ns */
+	__u64 below;		/* time below the refill threshold in ns */
+	__u64 empty;		/* time with an empty pool in ns */
+	unsigned long long wakeups;	/* wakeups of the daemon */
+	unsigned long long refills;	/* completed injections */
+	unsigned long long bytes;	/* bytes injected */
+	double cpu;		/* CPU seconds used */
+};
+
+/*
+ * Refill latencies: time from the pool dropping to the refill threshold to
+ * the next credited injection, in ns
+ */
+struct rngd_sim_latency {
+	__u64 *lat;		/* buffer provided by the caller */
+	size_t max;		/* size of the buffer */
+	size_t nr;		/* latencies recorded */
+	size_t lost;		/* latencies not fitting into the buffer */
+};
+
+void rngd_sim_model_init(struct rngd_sim_model *model);
+int rngd_sim_run(const struct rngd_sched *sched,
+		 const struct rngd_sim_model *model,
+		 const struct rngd_demand *demand, size_t nr,
+		 struct rngd_sim_result *result,
+		 struct rngd_sim_latency *latency);
+
+#endif /* _JITTERENTROPY_RNGD_SCHED_H */
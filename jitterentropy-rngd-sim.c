@@ -0,0 +1,192 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Replay of entropy demand traces against the scheduling of jitterentropy-rngd
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * jent-rngd-sim replays a trace recorded by jitterentropy-rngd -T against
+ * the scheduling logic of the daemon with several configurations. For each
+ * configuration, it reports the share of time the simulated pool spent at
+ * or below the refill threshold and empty, and the CPU time the collectors
+ * would have used.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "jitterentropy-rngd-sched.h"
+
+#define MAX_CONFIGS 64
+
+static struct rngd_sched Configs[MAX_CONFIGS];
+static unsigned int Nr_configs = 0;
+static struct rngd_sim_model Model;
+
+static void usage(void)
+{
+	fprintf(stderr, "\nReplay a jitterentropy-rngd trace against daemon configurations\n\n");
+	fprintf(stderr, "Usage: jent-rngd-sim [options] trace\n");
+	fprintf(stderr, "\t-c\tConfiguration threshold:batch:interval, may be given\n");
+	fprintf(stderr, "\t\tup to %d times (default %d:%d:%d)\n", MAX_CONFIGS,
+		RNGD_SCHED_THRESHOLD, RNGD_SCHED_BATCH, RNGD_SCHED_INTERVAL);
+	fprintf(stderr, "\t-r\tCollector throughput in bytes per second\n");
+	fprintf(stderr, "\t\t(default: measured in the trace)\n");
+	fprintf(stderr, "\t-u\tCPU nanoseconds per byte gathered\n");
+	fprintf(stderr, "\t\t(default: measured in the trace)\n");
+	fprintf(stderr, "\t-s\tSize of the pool in bits (default %d)\n",
+		RNGD_POOL_SIZE);
+	fprintf(stderr, "\t-w\tWrite wakeup threshold of the kernel in bits\n");
+	fprintf(stderr, "\t\t(default %d)\n", RNGD_POOL_WAKEUP);
+	exit(1);
+}
+
+static void parse_config(const char *arg)
+{
+	struct rngd_sched *sched;
+
+	if (MAX_CONFIGS <= Nr_configs)
+		usage();
+	sched = &Configs[Nr_configs];
+	rngd_sched_init(sched);
+	if (3 != sscanf(arg, "%u:%u:%u", &sched->threshold, &sched->batch,
+			&sched->interval) ||
+	    !sched->batch || RNGD_SCHED_MAX_BATCH < sched->batch ||
+	    !sched->interval)
+		usage();
+	Nr_configs++;
+}
+
+int main(int argc, char *argv[])
+{
+	struct rngd_demand *demand = NULL;
+	double throughput = 0, cpu_per_byte = 0;
+	__u64 total = 0;
+	size_t nr = 0, i;
+	FILE *f;
+	int c, ret;
+
+	rngd_sim_model_init(&Model);
+	Model.throughput = -1;
+	Model.cpu_per_byte = -1;
+	while (1) {
+		int opt_index = 0;
+		static struct option opts[] = {
+			{"config", 1, 0, 'c'},
+			{"throughput", 1, 0, 'r'},
+			{"cpu", 1, 0, 'u'},
+			{"size", 1, 0, 's'},
+			{"wakeup", 1, 0, 'w'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "c:r:u:s:w:", opts, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'c':
+			parse_config(optarg);
+			break;
+		case 'r':
+			Model.throughput = strtod(optarg, NULL);
+			break;
+		case 'u':
+			Model.cpu_per_byte = strtod(optarg, NULL) / 1e9;
+			break;
+		case 's':
+			Model.pool_size = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			Model.wakeup = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind + 1 != argc)
+		usage();
+	if (!Nr_configs)
+		rngd_sched_init(&Configs[Nr_configs++]);
+
+	f = fopen(argv[optind], "r");
+	if (!f) {
+		fprintf(stderr, "Cannot open %s: %s\n", argv[optind],
+			strerror(errno));
+		return 1;
+	}
+	ret = rngd_demand_from_trace(f, Model.pool_size, &demand, &nr,
+				     &throughput, &cpu_per_byte);
+	fclose(f);
+	if (ret || !nr) {
+		fprintf(stderr, "Trace %s holds no usable demand\n",
+			argv[optind]);
+		return 1;
+	}
+	if (0 > Model.throughput)
+		Model.throughput = throughput;
+	if (0 > Model.cpu_per_byte)
+		Model.cpu_per_byte = cpu_per_byte;
+	if (0 >= Model.throughput) {
+		fprintf(stderr, "Trace has no injections, specify the throughput\n");
+		return 1;
+	}
+	for (i = 0; i < nr; i++)
+		total += demand[i].duration;
+
+	printf("Trace:\t\t%zu segments, %.1f s\n", nr, total / 1e9);
+	printf("Collectors:\t%.0f bytes/s, %.0f CPU ns/byte\n", Model.throughput,
+	       Model.cpu_per_byte * 1e9);
+	printf("Pool:\t\t%u bits, write wakeup threshold %u bits\n\n",
+	       Model.pool_size, Model.wakeup);
+	printf("threshold  batch interval  below[%%]  empty[%%]   wakeups   refills    cpu[s]\n");
+	for (i = 0; i < Nr_configs; i++) {
+		struct rngd_sim_result res;
+
+		if (rngd_sim_run(&Configs[i], &Model, demand, nr, &res, NULL))
+			continue;
+		printf("%9u %6u %8u %9.3f %9.3f %9llu %9llu %9.3f\n",
+		       Configs[i].threshold, Configs[i].batch,
+		       Configs[i].interval,
+		       100.0 * res.below / res.duration,
+		       100.0 * res.empty / res.duration,
+		       res.wakeups, res.refills, res.cpu);
+	}
+	free(demand);
+
+	return 0;
+}
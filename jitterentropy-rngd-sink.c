@@ -0,0 +1,387 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Output sinks of jitterentropy-rngd
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * A sink takes the entropy gathered by the daemon. The daemon feeds every
+ * configured sink with its own data on each refill -- data is never handed
+ * to two sinks -- as long as the budget of the sink allows. Sinks are
+ * specified as
+ *
+ *	kernel			RNDADDENTROPY on /dev/random, the default
+ *	file:<path>		appended to a regular file or written to a
+ *				FIFO, data is dropped while the FIFO is full
+ *	socket:<path>		UNIX stream socket, each write goes to the
+ *				next connected client
+ *	fake[:<drain>]		in-process input_pool drained by <drain> bits
+ *				per second (default 100), standing in for
+ *				/dev/random without root or a kernel pool
+ *
+ * optionally followed by @<bytes per second> limiting the data written to
+ * the sink.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/random.h>
+
+#include "jitterentropy-rngd-sink.h"
+
+#define RNGD_SINK_DEV		"/dev/random"
+#define RNGD_SINK_AVAIL		"/proc/sys/kernel/random/entropy_avail"
+
+static __u64 rngd_sink_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Initialize a sink from its specification.
+ *
+ * return: 0 on success, -EINVAL for an invalid specification
+ */
+int rngd_sink_parse(struct rngd_sink *sink, const char *spec)
+{
+	char *budget, *arg;
+
+	memset(sink, 0, sizeof(*sink));
+	sink->fd = -1;
+	sink->avail_fd = -1;
+	if (strlen(spec) >= sizeof(sink->spec))
+		return -EINVAL;
+	strcpy(sink->spec, spec);
+
+	budget = strrchr(sink->spec, '@');
+	if (budget) {
+		*budget++ = '\0';
+		sink->budget = strtod(budget, NULL);
+		if (0 >= sink->budget)
+			return -EINVAL;
+	}
+	arg = strchr(sink->spec, ':');
+	if (arg)
+		*arg++ = '\0';
+
+	if (!strcmp(sink->spec, "kernel") && !arg) {
+		sink->type = RNGD_SINK_KERNEL;
+	} else if (!strcmp(sink->spec, "file") && arg && *arg) {
+		sink->type = RNGD_SINK_FILE;
+		sink->path = arg;
+	} else if (!strcmp(sink->spec, "socket") && arg && *arg) {
+		sink->type = RNGD_SINK_SOCKET;
+		sink->path = arg;
+	} else if (!strcmp(sink->spec, "fake")) {
+		sink->type = RNGD_SINK_FAKE;
+		sink->drain = arg ? strtod(arg, NULL) : RNGD_SINK_FAKE_DRAIN;
+		if (0 > sink->drain)
+			return -EINVAL;
+	} else {
+		return -EINVAL;
+	}
+
+	/* restore the specification for messages */
+	strcpy(sink->spec, spec);
+	if (sink->path)
+		sink->path = sink->spec + (sink->path - sink->spec);
+	if (budget)
+		*strrchr(sink->spec, '@') = '\0';
+	return 0;
+}
+
+static int rngd_sink_open_socket(struct rngd_sink *sink)
+{
+	struct sockaddr_un addr;
+
+	if (strlen(sink->path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sink->path);
+
+	sink->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			  0);
+	if (0 > sink->fd)
+		return -errno;
+	unlink(sink->path);
+	if (bind(sink->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sink->fd, RNGD_SINK_CLIENTS))
+		return -errno;
+	return 0;
+}
+
+/*
+ * Open a sink for writes of up to @max_len bytes.
+ *
+ * return: 0 on success, < 0 on error
+ */
+int rngd_sink_open(struct rngd_sink *sink, size_t max_len)
+{
+	struct stat st;
+
+	sink->max_len = max_len;
+	sink->refilled = rngd_sink_now();
+	sink->tokens = (sink->budget > max_len) ? sink->budget : max_len;
+
+	switch (sink->type) {
+	case RNGD_SINK_KERNEL:
+		sink->rpi = malloc(sizeof(struct rand_pool_info) + max_len);
+		if (!sink->rpi)
+			return -ENOMEM;
+		sink->fd = open(RNGD_SINK_DEV, O_WRONLY);
+		if (0 > sink->fd)
+			return -errno;
+		sink->avail_fd = open(RNGD_SINK_AVAIL, O_RDONLY);
+		if (0 > sink->avail_fd)
+			return -errno;
+		return 0;
+	case RNGD_SINK_FILE:
+		/* a FIFO without reader must neither block nor fail */
+		if (!stat(sink->path, &st) && S_ISFIFO(st.st_mode))
+			sink->fd = open(sink->path, O_RDWR | O_NONBLOCK);
+		else
+			sink->fd = open(sink->path,
+					O_WRONLY | O_CREAT | O_APPEND, 0600);
+		return (0 > sink->fd) ? -errno : 0;
+	case RNGD_SINK_SOCKET:
+		return rngd_sink_open_socket(sink);
+	case RNGD_SINK_FAKE:
+		rngd_pool_init(&sink->pool, RNGD_POOL_SIZE, RNGD_POOL_WAKEUP,
+			       RNGD_POOL_SIZE);
+		sink->last = rngd_sink_now();
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+void rngd_sink_close(struct rngd_sink *sink)
+{
+	unsigned int i;
+
+	for (i = 0; i < sink->nr_clients; i++)
+		close(sink->clients[i]);
+	sink->nr_clients = 0;
+	if (0 <= sink->fd) {
+		close(sink->fd);
+		if (RNGD_SINK_SOCKET == sink->type)
+			unlink(sink->path);
+	}
+	sink->fd = -1;
+	if (0 <= sink->avail_fd)
+		close(sink->avail_fd);
+	sink->avail_fd = -1;
+	if (sink->rpi) {
+		memset(sink->rpi, 0,
+		       sizeof(struct rand_pool_info) + sink->max_len);
+		free(sink->rpi);
+		sink->rpi = NULL;
+	}
+}
+
+/* whether the sink credits entropy at all */
+int rngd_sink_credits(const struct rngd_sink *sink)
+{
+	return (RNGD_SINK_KERNEL == sink->type || RNGD_SINK_FAKE == sink->type);
+}
+
+/*
+ * Check whether @len bytes may be written to the sink now. The budget is a
+ * token bucket allowing bursts of one second.
+ *
+ * return: 1 if the write is permitted and accounted, 0 otherwise
+ */
+int rngd_sink_budget(struct rngd_sink *sink, size_t len)
+{
+	double max = (sink->budget > sink->max_len) ?
+		     sink->budget : sink->max_len;
+	__u64 now;
+
+	if (!sink->budget)
+		return 1;
+
+	now = rngd_sink_now();
+	sink->tokens += sink->budget * (now - sink->refilled) / 1e9;
+	sink->refilled = now;
+	if (sink->tokens > max)
+		sink->tokens = max;
+	if (sink->tokens < len) {
+		sink->skipped++;
+		return 0;
+	}
+	sink->tokens -= len;
+	return 1;
+}
+
+static void rngd_sink_accept(struct rngd_sink *sink)
+{
+	while (RNGD_SINK_CLIENTS > sink->nr_clients) {
+		int fd = accept4(sink->fd, NULL, NULL,
+				 SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (0 > fd)
+			break;
+		sink->clients[sink->nr_clients++] = fd;
+	}
+}
+
+static ssize_t rngd_sink_write_socket(struct rngd_sink *sink,
+				      const char *buf, size_t len)
+{
+	unsigned int tries;
+
+	rngd_sink_accept(sink);
+	tries = sink->nr_clients;
+	while (tries-- && sink->nr_clients) {
+		unsigned int i = sink->next_client++ % sink->nr_clients;
+		ssize_t ret = send(sink->clients[i], buf, len,
+				   MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (0 <= ret)
+			return ret;
+		if (EAGAIN == errno || EWOULDBLOCK == errno)
+			continue;
+		/* the client went away */
+		close(sink->clients[i]);
+		sink->clients[i] = sink->clients[--sink->nr_clients];
+	}
+
+	return 0;
+}
+
+static void rngd_sink_fake_update(struct rngd_sink *sink)
+{
+	__u64 now = rngd_sink_now();
+
+	rngd_pool_drain(&sink->pool, sink->drain * (now - sink->last) / 1e9);
+	sink->last = now;
+}
+
+/*
+ * Write to a sink, crediting @bits of entropy where the sink supports it.
+ * Only the kernel and the fake sink credit entropy, and only when they
+ * took all of @buf. The bits actually credited are stored in @credited.
+ *
+ * return: bytes taken by the sink, < 0 on error
+ */
+ssize_t rngd_sink_write(struct rngd_sink *sink, const char *buf, size_t len,
+			unsigned int bits, unsigned int *credited)
+{
+	ssize_t ret = 0;
+
+	*credited = 0;
+	if (len > sink->max_len)
+		return -EINVAL;
+
+	switch (sink->type) {
+	case RNGD_SINK_KERNEL:
+		sink->rpi->entropy_count = bits;
+		sink->rpi->buf_size = len;
+		memcpy(sink->rpi->buf, buf, len);
+		ret = ioctl(sink->fd, RNDADDENTROPY, sink->rpi);
+		ret = (-1 == ret) ? -errno : (ssize_t)len;
+		sink->rpi->entropy_count = 0;
+		sink->rpi->buf_size = 0;
+		memset(sink->rpi->buf, 0, len);
+		break;
+	case RNGD_SINK_FILE:
+		ret = write(sink->fd, buf, len);
+		if (0 > ret)
+			ret = (EAGAIN == errno) ? 0 : -errno;
+		break;
+	case RNGD_SINK_SOCKET:
+		ret = rngd_sink_write_socket(sink, buf, len);
+		break;
+	case RNGD_SINK_FAKE:
+		rngd_sink_fake_update(sink);
+		rngd_pool_credit(&sink->pool, bits);
+		ret = len;
+		break;
+	}
+
+	if (0 > ret)
+		return ret;
+	sink->bytes += ret;
+	sink->dropped += len - ret;
+	if ((size_t)ret == len && rngd_sink_credits(sink)) {
+		*credited = bits;
+		sink->credited += bits;
+	}
+	return ret;
+}
+
+/*
+ * Entropy available in the pool behind the sink.
+ *
+ * return: entropy in bits, -1 if the sink has no pool, < -1 on error
+ */
+int rngd_sink_avail(struct rngd_sink *sink)
+{
+	char buf[16];
+	ssize_t data;
+
+	switch (sink->type) {
+	case RNGD_SINK_KERNEL:
+		data = pread(sink->avail_fd, buf, sizeof(buf) - 1, 0);
+		if (0 >= data)
+			return -EIO;
+		buf[data] = '\0';
+		return atoi(buf);
+	case RNGD_SINK_FAKE:
+		rngd_sink_fake_update(sink);
+		return (int)sink->pool.level;
+	default:
+		return -1;
+	}
+}
+
+/* descriptor signalling that the pool wants entropy, -1 if none */
+int rngd_sink_poll_fd(const struct rngd_sink *sink)
+{
+	return (RNGD_SINK_KERNEL == sink->type) ? sink->fd : -1;
+}
@@ -0,0 +1,59 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * Output sinks of jitterentropy-rngd
+ *
+ * See jitterentropy-rngd-sink.c for the license.
+ */
+
+#ifndef _JITTERENTROPY_RNGD_SINK_H
+#define _JITTERENTROPY_RNGD_SINK_H
+
+#include <sys/types.h>
+
+#include "jitterentropy-rngd-sched.h"
+
+enum rngd_sink_type {
+	RNGD_SINK_KERNEL,	/* RNDADDENTROPY on /dev/random */
+	RNGD_SINK_FILE,		/* regular file or FIFO */
+	RNGD_SINK_SOCKET,	/* UNIX stream socket service */
+	RNGD_SINK_FAKE,		/* in-process model of the input_pool */
+};
+
+#define RNGD_SINK_CLIENTS	16
+#define RNGD_SINK_FAKE_DRAIN	100
+
+struct rngd_sink {
+	enum rngd_sink_type type;
+	char spec[256];		/* specification the sink was created from */
+	char *path;		/* file or socket path */
+	int fd;			/* /dev/random, file or listening socket */
+	int avail_fd;		/* entropy_avail of the kernel */
+	struct rand_pool_info *rpi;
+	size_t max_len;
+	int clients[RNGD_SINK_CLIENTS];	/* connected socket clients */
+	unsigned int nr_clients;
+	unsigned int next_client;
+	struct rngd_pool pool;	/* fake input_pool */
+	double drain;		/* drain of the fake pool in bits per second */
+	__u64 last;		/* last update of the fake pool in ns */
+	double budget;		/* bytes per second, 0 for no limit */
+	double tokens;		/* bytes which may be written now */
+	__u64 refilled;		/* last refill of the tokens in ns */
+	unsigned long long bytes;	/* bytes written */
+	unsigned long long credited;	/* bits of entropy credited */
+	unsigned long long dropped;	/* bytes nobody took */
+	unsigned long long skipped;	/* writes skipped for the budget */
+};
+
+int rngd_sink_parse(struct rngd_sink *sink, const char *spec);
+int rngd_sink_open(struct rngd_sink *sink, size_t max_len);
+void rngd_sink_close(struct rngd_sink *sink);
+int rngd_sink_credits(const struct rngd_sink *sink);
+int rngd_sink_budget(struct rngd_sink *sink, size_t len);
+ssize_t rngd_sink_write(struct rngd_sink *sink, const char *buf, size_t len,
+			unsigned int bits, unsigned int *credited);
+int rngd_sink_avail(struct rngd_sink *sink);
+int rngd_sink_poll_fd(const struct rngd_sink *sink);
+
+#endif /* _JITTERENTROPY_RNGD_SINK_H */
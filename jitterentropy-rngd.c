@@ -36,6 +36,7 @@
  * DAMAGE.
  */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -44,37 +45,60 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/ioctl.h>
-#define _GNU_SOURCE
 #include <getopt.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <linux/random.h>
 #include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <math.h>
 
 #include "jitterentropy.h"
+#include "jitterentropy-estimate.h"
+#include "jitterentropy-topology.h"
+#include "jitterentropy-fips140.h"
+#include "jitterentropy-rngd-sched.h"
+#include "jitterentropy-rngd-sink.h"
 
 static int Verbosity = 0;
 
-struct kernel_rng {
-	int fd;
+/*
+ * Entropy collector -- with more than one entropy collector, each one runs
+ * on its own thread pinned to a CPU, spreading the threads across physical
+ * cores before SMT siblings are used.
+ */
+struct collector {
 	struct rand_data *ec;
-	struct rand_pool_info *rpi;
-	const char *dev;
+	int cpu;		/* CPU the thread is pinned to, -1 if none */
+	pthread_t thread;
+	char *buf;		/* output buffer of the current request */
+	size_t len;
+	int ret;		/* result of the current request */
+};
+
+struct kernel_rng {
+	struct collector *collectors;
+	unsigned int nr_collectors;
+	unsigned int osr;
 };
 
 static struct kernel_rng Random = {
-	.fd = 0,
-	.ec = NULL,
-	.rpi = NULL,
-	.dev = "/dev/random"
+	.collectors = NULL,
+	.nr_collectors = 0,
+	.osr = 1
 };
 
+/* Sinks fed by the daemon, the kernel if none is given */
+#define MAX_SINKS 8
+static struct rngd_sink Sinks[MAX_SINKS];
+static unsigned int Nr_sinks = 0;
+
 /*
  * handler for /dev/urandom not needed as used IOCTL alters input_pool
 static struct kernel_rng Urandom = {
 	.fd = 0,
-	.ec = NULL,
+	.collectors = NULL,
 	.rpi = NULL,
 	.dev = "/dev/urandom"
 };
@@ -84,13 +108,117 @@ static int Pidfile_fd = 0;
 /* "/var/run/jitterentropy-rngd.pid" */
 static char *Pidfile = NULL;
 
-static int Entropy_avail_fd = 0;
+/* Refill threshold, batch size and check interval */
+static struct rngd_sched Sched = {
+	.threshold = RNGD_SCHED_THRESHOLD,
+	.batch = RNGD_SCHED_BATCH,
+	.interval = RNGD_SCHED_INTERVAL,
+};
+
+/* Trace of the wakeups -- only accessed by the main thread */
+static char *Tracefile = NULL;
+static FILE *Trace = NULL;
+static __u64 Trace_start = 0;
+
+/* Oversampling rate requested by the user */
+static unsigned int Osr = 1;
+
+/* Number of entropy collectors requested by the user */
+static unsigned int Nr_collectors = 1;
+/* Hand-off of requests to the collector threads */
+static pthread_mutex_t Work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t Done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long Work_gen = 0;
+static unsigned int Work_pending = 0;
+
+static volatile sig_atomic_t Alarm_pending = 0;
+static volatile sig_atomic_t Stats_pending = 0;
 
-#define RNDBYTES 256
-#define ENTROPYTRHESH 1024
-#define ENTROPYAVAIL "/proc/sys/kernel/random/entropy_avail"
+/*
+ * Statistics written to the file Statsfile on SIGUSR1 -- only accessed by
+ * the main thread.
+ */
+static char *Statsfile = NULL;
+struct rngd_stats {
+	unsigned long long requests;	/* Requests for entropy */
+	unsigned long long bytes;	/* Bytes injected */
+	unsigned long long credited;	/* Bits of entropy credited */
+	unsigned long long withheld;	/* Bits not credited for failed
+					 * FIPS 140-2 blocks */
+	unsigned long long failures;	/* Failed requests */
+};
+static struct rngd_stats Stats;
+
+/*
+ * FIPS 140-2 statistical tests applied to all data injected by the daemon
+ * -- only accessed by the main thread. A batch completing a failed block is
+ * injected without credit, and so is all data up to the next block passing
+ * the tests. The earlier batches of the failed block were already credited
+ * when they were injected.
+ */
+static int Fips140 = 0;
+static struct jent_fips140 Fips140_state;
+static int Fips140_withhold = 0;
+
+/*
+ * Periodic self test: the timer tests of jent_entropy_init and a short
+ * entropy estimate are repeated on an idle thread every Selftest_interval
+ * seconds and whenever the clocksource of the kernel changes. If the
+ * quality drops, the oversampling rate is raised. If the timer tests fail,
+ * the output is paused and the self test is repeated every second until
+ * they pass again.
+ */
+#define CLOCKSOURCE "/sys/devices/system/clocksource/clocksource0/current_clocksource"
+#define SELFTEST_SAMPLES 4096
+#define MAX_OSR 16
+static unsigned int Selftest_interval = 0;
+static pthread_t Selftest_thread;
+static pthread_mutex_t Osr_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Oversampling rate required by the self test */
+static unsigned int Osr_required = 1;
+
+/*
+ * Migration monitor: live migration and heavy steal time change the timer
+ * characteristics the self test validated. The self test thread watches
+ * the steal time in /proc/stat and the median of a small window of raw
+ * time deltas. When the steal time rises above STEAL_THRESHOLD percent or
+ * the median moves by more than a factor of SHIFT_FACTOR, the output is
+ * paused and the self test is repeated right away.
+ */
+#define PROCSTAT "/proc/stat"
+#define STEAL_THRESHOLD 10
+#define SHIFT_SAMPLES 256
+#define SHIFT_FACTOR 2
+static int Monitor = 0;
+/* Output paused until the self test completed -- protected by Osr_lock */
+static int Output_paused = 0;
+
+/*
+ * Correlation monitor: entropy collectors running in parallel may be
+ * correlated through shared caches, the shared timer or interrupts. The
+ * first CORR_WORDS 64 bit words every entropy collector contributes to a
+ * request are handed to a background thread. For every pair of entropy
+ * collectors it counts the agreeing bits and identical words. Once
+ * CORR_WINDOW bits are compared per pair, the bit correlation is
+ * evaluated: if it exceeds CORR_SIGMA standard deviations of an
+ * uncorrelated source or any word collided, only the entropy of one
+ * entropy collector is credited until a following window is clean.
+ */
+#define CORR_WORDS 4
+#define CORR_WINDOW 65536
+#define CORR_SIGMA 5
+static int Correlation = 0;
+static pthread_t Corr_thread;
+static pthread_mutex_t Corr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Corr_cond = PTHREAD_COND_INITIALIZER;
+static __u64 *Corr_sample = NULL;	/* CORR_WORDS per collector */
+static unsigned int Corr_words = 0;	/* valid words per collector */
+/* Percentage of the full entropy credited -- protected by Osr_lock */
+static unsigned int Credit = 100;
 
 static void install_alarm(void);
+static void corr_submit(struct kernel_rng *rng, char *buf, size_t share);
 static void dealloc(void);
 static void dealloc_rng(struct kernel_rng *rng);
 
@@ -101,6 +229,32 @@ static void usage(void)
 	fprintf(stderr, "\t-v\tVerbose logging, multiple options increase verbosity\n");
 	fprintf(stderr, "\t\tVerbose logging implies running in foreground\n");
 	fprintf(stderr, "\t-p\tWrite daemon PID to file\n");
+	fprintf(stderr, "\t-o\tOversampling rate of the entropy collector (default 1)\n");
+	fprintf(stderr, "\t-t\tRepeat the self tests every given number of seconds\n");
+	fprintf(stderr, "\t\tand on clocksource changes, raising the oversampling\n");
+	fprintf(stderr, "\t\trate when the quality drops (default 0: disabled)\n");
+	fprintf(stderr, "\t-m\tMonitor steal time and shifts of the time deltas and\n");
+	fprintf(stderr, "\t\trepeat the self tests on migration of the system\n");
+	fprintf(stderr, "\t-n\tNumber of entropy collectors running in parallel on\n");
+	fprintf(stderr, "\t\tseparate physical cores where possible, up to the\n");
+	fprintf(stderr, "\t\tbatch size given with -b (default 1)\n");
+	fprintf(stderr, "\t-c\tMonitor the correlation between the collectors and\n");
+	fprintf(stderr, "\t\treduce the credited entropy when they correlate\n");
+	fprintf(stderr, "\t-f\tApply the FIPS 140-2 statistical tests to the output\n");
+	fprintf(stderr, "\t\tand credit nothing for data of failed blocks\n");
+	fprintf(stderr, "\t-S\tWrite statistics to file on SIGUSR1\n");
+	fprintf(stderr, "\t-e\tRefill when entropy_avail is at or below the given\n");
+	fprintf(stderr, "\t\tnumber of bits (default %d)\n", RNGD_SCHED_THRESHOLD);
+	fprintf(stderr, "\t-b\tBytes injected per refill, up to %d (default %d)\n",
+		RNGD_SCHED_MAX_BATCH, RNGD_SCHED_BATCH);
+	fprintf(stderr, "\t-i\tSeconds between checks of entropy_avail (default %d)\n",
+		RNGD_SCHED_INTERVAL);
+	fprintf(stderr, "\t-T\tRecord entropy_avail and the wakeups in trace file\n");
+	fprintf(stderr, "\t-s\tFeed the given sink, may be given up to %d times:\n",
+		MAX_SINKS);
+	fprintf(stderr, "\t\tkernel (default), file:<path>, socket:<path> or\n");
+	fprintf(stderr, "\t\tfake[:<drain bits/s>], optionally followed by\n");
+	fprintf(stderr, "\t\t@<bytes/s> limiting the data written to the sink\n");
 	exit(1);
 }
 
@@ -110,11 +264,24 @@ static void parse_opts(int argc, char *argv[])
 	while (1) {
 		int opt_index = 0;
 		static struct option opts[] = {
-			{"verbose", 0, 0, 0},
-			{"pid", 1, 0, 0},
+			{"verbose", 0, 0, 'v'},
+			{"pid", 1, 0, 'p'},
+			{"osr", 1, 0, 'o'},
+			{"selftest", 1, 0, 't'},
+			{"monitor", 0, 0, 'm'},
+			{"collectors", 1, 0, 'n'},
+			{"correlation", 0, 0, 'c'},
+			{"fips140", 0, 0, 'f'},
+			{"stats", 1, 0, 'S'},
+			{"threshold", 1, 0, 'e'},
+			{"batch", 1, 0, 'b'},
+			{"interval", 1, 0, 'i'},
+			{"trace", 1, 0, 'T'},
+			{"sink", 1, 0, 's'},
 			{0, 0, 0, 0}
 		};
-		c = getopt_long(argc, argv, "vp:", opts, &opt_index);
+		c = getopt_long(argc, argv, "vp:o:t:mn:cfS:e:b:i:T:s:", opts,
+				&opt_index);
 		if (-1 == c)
 			break;
 		switch (c) {
@@ -124,10 +291,61 @@ static void parse_opts(int argc, char *argv[])
 		case 'p':
 			Pidfile = optarg;
 			break;
+		case 'o':
+			Osr = strtoul(optarg, NULL, 10);
+			if (!Osr || MAX_OSR < Osr)
+				usage();
+			break;
+		case 't':
+			Selftest_interval = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			Monitor = 1;
+			break;
+		case 'n':
+			Nr_collectors = strtoul(optarg, NULL, 10);
+			if (!Nr_collectors)
+				usage();
+			break;
+		case 'c':
+			Correlation = 1;
+			break;
+		case 'f':
+			Fips140 = 1;
+			break;
+		case 'S':
+			Statsfile = optarg;
+			break;
+		case 'e':
+			Sched.threshold = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			Sched.batch = strtoul(optarg, NULL, 10);
+			if (!Sched.batch || RNGD_SCHED_MAX_BATCH < Sched.batch)
+				usage();
+			break;
+		case 'i':
+			Sched.interval = strtoul(optarg, NULL, 10);
+			if (!Sched.interval)
+				usage();
+			break;
+		case 'T':
+			Tracefile = optarg;
+			break;
+		case 's':
+			if (MAX_SINKS <= Nr_sinks ||
+			    rngd_sink_parse(&Sinks[Nr_sinks], optarg))
+				usage();
+			Nr_sinks++;
+			break;
 		default:
 			usage();
 		}
 	}
+
+	/* every entropy collector must obtain a share of each batch */
+	if (Sched.batch < Nr_collectors)
+		usage();
 }
 
 #define LOG_DEBUG	3
@@ -174,71 +392,283 @@ static void dolog(int severity, const char *fmt, ...)
  * entropy handler functions
  *******************************************************************/
 
-static size_t write_random(struct kernel_rng *rng, char *buf, size_t len)
+static size_t write_random(struct rngd_sink *sink, char *buf, size_t len,
+			   int withhold)
 {
-	size_t written = 0;
-	rng->rpi->entropy_count = (RNDBYTES * 8); /* value is in bits */
-	rng->rpi->buf_size = RNDBYTES;
-	memcpy(rng->rpi->buf, buf, RNDBYTES);
-	memset(buf, 0, RNDBYTES);
-
-	if (-1 == ioctl(rng->fd, RNDADDENTROPY, rng->rpi))
-		dolog(LOG_WARN, "Error injecting entropy: %s", strerror(errno));
-	else {
-		dolog(LOG_DEBUG, "Injected %d bytes of entropy", RNDBYTES);
-		written = RNDBYTES;
+	ssize_t written = 0;
+	unsigned int credit = 100;
+	unsigned int bits = 0;
+	unsigned int credited = 0;
+
+	pthread_mutex_lock(&Osr_lock);
+	credit = Credit;
+	pthread_mutex_unlock(&Osr_lock);
+
+	/* value is in bits */
+	bits = (len * 8 * credit) / 100;
+	if (withhold) {
+		if (rngd_sink_credits(sink))
+			Stats.withheld += bits;
+		bits = 0;
 	}
+	written = rngd_sink_write(sink, buf, len, bits, &credited);
+	memset(buf, 0, len);
 
-	rng->rpi->entropy_count = 0;
-	rng->rpi->buf_size = 0;
-	memset(rng->rpi->buf, 0, RNDBYTES);
+	if (0 > written) {
+		dolog(LOG_WARN, "Error injecting entropy into %s: %s",
+		      sink->spec, strerror(-written));
+		return 0;
+	}
+	dolog(LOG_DEBUG, "Injected %ld bytes of entropy into %s", written,
+	      sink->spec);
+	Stats.credited += credited;
 
 	return written;
 }
 
-static size_t gather_entropy(struct kernel_rng *rng)
+/*
+ * Apply the oversampling rate required by the user and the self test by
+ * replacing the entropy collector.
+ */
+static void update_osr(struct kernel_rng *rng)
 {
-	char buf[RNDBYTES];
-	size_t ret = 0;
+	unsigned int osr = Osr;
+	unsigned int i;
+
+	pthread_mutex_lock(&Osr_lock);
+	if (Osr_required > osr)
+		osr = Osr_required;
+	pthread_mutex_unlock(&Osr_lock);
+
+	if (osr == rng->osr)
+		return;
+
+	dolog(LOG_WARN, "Changing oversampling rate from %u to %u",
+	      rng->osr, osr);
+	/* the collector threads are idle while the main thread is here */
+	for (i = 0; i < rng->nr_collectors; i++) {
+		struct rand_data *ec = jent_entropy_collector_alloc(osr, 0);
+
+		if (!ec) {
+			dolog(LOG_WARN, "Cannot allocate entropy collector with oversampling rate %u", osr);
+			continue;
+		}
+		jent_entropy_collector_free(rng->collectors[i].ec);
+		rng->collectors[i].ec = ec;
+	}
+	rng->osr = osr;
+}
 
-	if (0 > jent_read_entropy(rng->ec, buf, RNDBYTES)) {
-		dolog(LOG_WARN, "Cannot read entropy");
-		return 0;
+/*
+ * Collector thread: wait for a request from gather_entropy and fill the
+ * assigned part of the buffer.
+ */
+static void *collector_thread(void *arg)
+{
+	struct collector *c = arg;
+	unsigned long gen = 0;
+	sigset_t all;
+
+	/* signals are handled by the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+	while (1) {
+		pthread_mutex_lock(&Work_lock);
+		while (gen == Work_gen)
+			pthread_cond_wait(&Work_cond, &Work_lock);
+		gen = Work_gen;
+		pthread_mutex_unlock(&Work_lock);
+
+		c->ret = jent_read_entropy(c->ec, c->buf, c->len);
+
+		pthread_mutex_lock(&Work_lock);
+		if (!--Work_pending)
+			pthread_cond_signal(&Done_cond);
+		pthread_mutex_unlock(&Work_lock);
 	}
-	ret = write_random(rng, buf, RNDBYTES);
-	if (RNDBYTES != ret)
-		dolog(LOG_WARN, "Injected %lu bytes into %s, expected %d",
-			ret, rng->dev, RNDBYTES);
-	memset(buf, 0, RNDBYTES);
 
-	return RNDBYTES;
+	return NULL;
 }
 
-static int read_entropy_avail(int fd)
+/*
+ * Obtain entropy from all entropy collectors, each one filling its share
+ * of the buffer in parallel.
+ *
+ * return: < 0 if any entropy collector failed
+ */
+static int read_collectors(struct kernel_rng *rng, char *buf, size_t len)
 {
-	ssize_t data = 0;
-	char buf[5];
-	int entropy = 0;
+	size_t share = len / rng->nr_collectors;
+	unsigned int i;
 
-	data = read(fd, buf, sizeof(buf));
-	lseek(fd, 0, SEEK_SET);
+	if (1 == rng->nr_collectors)
+		return jent_read_entropy(rng->collectors[0].ec, buf, len);
 
-	if (0 > data) {
-		dolog(LOG_WARN, "Error reading data from entropy_avail: %s", strerror(errno));
-		return 0;
+	pthread_mutex_lock(&Work_lock);
+	for (i = 0; i < rng->nr_collectors; i++) {
+		rng->collectors[i].buf = buf + i * share;
+		rng->collectors[i].len = share;
+		rng->collectors[i].ret = 0;
 	}
-	if (0 == data) {
-		dolog(LOG_WARN, "Could not read data from entropy_avail");
+	/* the last entropy collector fills the remainder */
+	rng->collectors[i - 1].len = len - (i - 1) * share;
+	Work_pending = rng->nr_collectors;
+	Work_gen++;
+	pthread_cond_broadcast(&Work_cond);
+	while (Work_pending)
+		pthread_cond_wait(&Done_cond, &Work_lock);
+	pthread_mutex_unlock(&Work_lock);
+
+	for (i = 0; i < rng->nr_collectors; i++)
+		if (0 > rng->collectors[i].ret)
+			return rng->collectors[i].ret;
+	if (Correlation)
+		corr_submit(rng, buf, share);
+	return len;
+}
+
+/*
+ * Gather one batch for every sink whose budget permits it -- no data is
+ * ever handed to more than one sink.
+ *
+ * return: bytes written to all sinks
+ */
+static size_t gather_entropy(struct kernel_rng *rng)
+{
+	char buf[RNGD_SCHED_MAX_BATCH];
+	size_t len = Sched.batch;
+	size_t ret = 0, total = 0;
+	unsigned int i;
+	int paused = 0;
+
+	pthread_mutex_lock(&Osr_lock);
+	paused = Output_paused;
+	pthread_mutex_unlock(&Osr_lock);
+	if (paused) {
+		dolog(LOG_VERBOSE, "Output paused until self test completed");
 		return 0;
 	}
 
-	entropy = atoi(buf);
-	if (0 > entropy || 4096 < entropy) {
-		dolog(LOG_WARN, "Entropy read from entropy_avail (%d) is outsize of range", entropy);
-		return 0;
+	update_osr(rng);
+	for (i = 0; i < Nr_sinks; i++) {
+		struct rngd_sink *sink = &Sinks[i];
+
+		if (!rngd_sink_budget(sink, len)) {
+			dolog(LOG_DEBUG, "Budget of %s exhausted", sink->spec);
+			continue;
+		}
+
+		Stats.requests++;
+		if (0 > read_collectors(rng, buf, len)) {
+			dolog(LOG_WARN, "Cannot read entropy");
+			Stats.failures++;
+			break;
+		}
+		if (Fips140) {
+			__u64 blocks = Fips140_state.blocks;
+
+			if (jent_fips140_update(&Fips140_state,
+						(unsigned char *)buf, len)) {
+				dolog(LOG_WARN, "FIPS 140-2 statistical test failed (result 0x%x), %llu of %llu blocks failed, withholding credit",
+				      Fips140_state.last_result,
+				      (unsigned long long)Fips140_state.failed_blocks,
+				      (unsigned long long)Fips140_state.blocks);
+				Fips140_withhold = 1;
+			} else if (blocks != Fips140_state.blocks) {
+				Fips140_withhold = 0;
+			}
+		}
+		ret = write_random(sink, buf, len, Fips140_withhold);
+		Stats.bytes += ret;
+		total += ret;
+		if (len != ret)
+			dolog(LOG_VERBOSE, "Injected %lu bytes into %s, expected %lu",
+			      ret, sink->spec, len);
+	}
+	memset(buf, 0, len);
+
+	return total;
+}
+
+/*
+ * Read the entropy available in the pool of the first sink having one.
+ *
+ * return: entropy in bits, 0 on error, -1 if no sink has a pool
+ */
+static int read_entropy_avail(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < Nr_sinks; i++) {
+		int entropy = rngd_sink_avail(&Sinks[i]);
+
+		if (-1 == entropy)
+			continue;
+		if (0 > entropy) {
+			dolog(LOG_WARN, "Error reading entropy_avail of %s: %s",
+			      Sinks[i].spec, strerror(-entropy));
+			return 0;
+		}
+		if (4096 < entropy) {
+			dolog(LOG_WARN, "Entropy read from entropy_avail (%d) is outsize of range", entropy);
+			return 0;
+		}
+		return entropy;
 	}
 
-	return entropy;
+	return -1;
+}
+
+static __u64 clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Handle a wakeup, gathering entropy if @gather is set, and record it in
+ * the trace.
+ *
+ * @wakeup: reason of the wakeup
+ * @avail: entropy_avail at the wakeup, -1 if not yet read
+ * @gather: gather and inject entropy
+ *
+ * return: bytes injected
+ */
+static size_t trace_wakeup(enum rngd_wakeup wakeup, int avail, int gather)
+{
+	struct rngd_trace_event ev;
+	unsigned long long credited = Stats.credited;
+	__u64 start, cpu;
+	size_t written = 0;
+
+	if (!Trace)
+		return gather ? gather_entropy(&Random) : 0;
+
+	if (0 > avail)
+		avail = read_entropy_avail();
+	start = clock_ns(CLOCK_MONOTONIC);
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+	if (gather)
+		written = gather_entropy(&Random);
+
+	ev.time = start - Trace_start;
+	ev.wakeup = wakeup;
+	ev.avail = avail;
+	ev.bytes = written;
+	ev.credited = Stats.credited - credited;
+	ev.gather = clock_ns(CLOCK_MONOTONIC) - start;
+	ev.cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	if (rngd_trace_write(Trace, &ev) || fflush(Trace)) {
+		dolog(LOG_WARN, "Cannot write trace, tracing stopped");
+		fclose(Trace);
+		Trace = NULL;
+	}
+
+	return written;
 }
 
 /*******************************************************************
@@ -247,30 +677,97 @@ static int read_entropy_avail(int fd)
 
 /*
  * Wakeup and check entropy_avail -- this covers the drain of entropy
- * from the nonblocking_pool via get_random_bytes
+ * from the nonblocking_pool via get_random_bytes. The check itself is
+ * performed by the main loop.
  */
 static void sig_entropy_avail(int sig)
+{
+	Alarm_pending = 1;
+}
+
+static void check_entropy_avail(void)
 {
 	int entropy = 0;
 	size_t written = 0;
 
-	dolog(LOG_VERBOSE, "Wakeup call for alarm on %s", ENTROPYAVAIL);
-	entropy = read_entropy_avail(Entropy_avail_fd);
+	dolog(LOG_VERBOSE, "Wakeup call for alarm on entropy_avail");
+	entropy = read_entropy_avail();
 
 	if (0 == entropy)
 		goto out;
-	if (ENTROPYTRHESH < entropy) {
+	if (!rngd_sched_decide(&Sched, RNGD_WAKEUP_ALARM, entropy)) {
 		dolog(LOG_DEBUG, "Sufficient entropy %d available", entropy);
+		trace_wakeup(RNGD_WAKEUP_ALARM, entropy, 0);
 		goto out;
 	}
 	dolog(LOG_DEBUG, "Insufficient entropy %d available", entropy);
-	written = gather_entropy(&Random);
-	dolog(LOG_VERBOSE, "%lu bytes written to /dev/random", written);
+	written = trace_wakeup(RNGD_WAKEUP_ALARM, entropy, 1);
+	dolog(LOG_VERBOSE, "%lu bytes written to the sinks", written);
 out:
 	install_alarm();
 	return;
 }
 
+/* request to write the statistics -- performed by the main loop */
+static void sig_stats(int sig)
+{
+	Stats_pending = 1;
+}
+
+static void write_stats(void)
+{
+	FILE *f = NULL;
+	unsigned int credit = 100;
+	unsigned int osr = 1;
+	unsigned int i;
+
+	if (!Statsfile)
+		return;
+	f = fopen(Statsfile, "w");
+	if (!f) {
+		dolog(LOG_WARN, "Cannot open statistics file %s: %s", Statsfile,
+		      strerror(errno));
+		return;
+	}
+	pthread_mutex_lock(&Osr_lock);
+	credit = Credit;
+	osr = Osr_required;
+	pthread_mutex_unlock(&Osr_lock);
+
+	fprintf(f, "requests=%llu\n", Stats.requests);
+	fprintf(f, "failures=%llu\n", Stats.failures);
+	fprintf(f, "bytes_injected=%llu\n", Stats.bytes);
+	fprintf(f, "bits_credited=%llu\n", Stats.credited);
+	if (Fips140)
+		fprintf(f, "bits_withheld=%llu\n", Stats.withheld);
+	fprintf(f, "collectors=%u\n", Random.nr_collectors);
+	fprintf(f, "osr=%u\n", Random.osr);
+	fprintf(f, "osr_required=%u\n", osr);
+	fprintf(f, "credit_percent=%u\n", credit);
+	for (i = 0; i < Nr_sinks; i++) {
+		fprintf(f, "sink%u=%s\n", i, Sinks[i].spec);
+		fprintf(f, "sink%u_bytes=%llu\n", i, Sinks[i].bytes);
+		fprintf(f, "sink%u_bits_credited=%llu\n", i, Sinks[i].credited);
+		fprintf(f, "sink%u_bytes_dropped=%llu\n", i, Sinks[i].dropped);
+		fprintf(f, "sink%u_budget_skipped=%llu\n", i, Sinks[i].skipped);
+	}
+	if (Fips140) {
+		fprintf(f, "fips140_blocks=%llu\n",
+			(unsigned long long)Fips140_state.blocks);
+		fprintf(f, "fips140_failed_blocks=%llu\n",
+			(unsigned long long)Fips140_state.failed_blocks);
+		fprintf(f, "fips140_monobit_failures=%llu\n",
+			(unsigned long long)Fips140_state.fail_monobit);
+		fprintf(f, "fips140_poker_failures=%llu\n",
+			(unsigned long long)Fips140_state.fail_poker);
+		fprintf(f, "fips140_runs_failures=%llu\n",
+			(unsigned long long)Fips140_state.fail_runs);
+		fprintf(f, "fips140_longrun_failures=%llu\n",
+			(unsigned long long)Fips140_state.fail_longrun);
+	}
+	fclose(f);
+}
+
 /* terminate the daemon cleanly */
 static void sig_term(int sig)
 {
@@ -281,26 +778,56 @@ static void sig_term(int sig)
 
 /*
  * Wakeup on insufficient entropy on /dev/random
+ *
+ * SIGALRM and SIGUSR1 are blocked outside of pselect, so they can only
+ * interrupt the wait and are never lost.
  */
 static void select_fd(void)
 {
 	fd_set fds;
 	int ret = 0;
 	size_t written = 0;
+	sigset_t alrm, waitmask;
+	int poll_fd = -1;
+	unsigned int i;
+
+	/* only /dev/random implements polling, other sinks rely on alarms */
+	for (i = 0; i < Nr_sinks && 0 > poll_fd; i++)
+		poll_fd = rngd_sink_poll_fd(&Sinks[i]);
+
+	sigemptyset(&alrm);
+	sigaddset(&alrm, SIGALRM);
+	sigaddset(&alrm, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &alrm, &waitmask);
+	sigdelset(&waitmask, SIGALRM);
+	sigdelset(&waitmask, SIGUSR1);
 
 	while (1) {
 		FD_ZERO(&fds);
-		dolog(LOG_DEBUG, "Polling /dev/random");
-		FD_SET(Random.fd, &fds);
-		/* only /dev/random implements polling */
-		ret = select((Random.fd + 1), NULL, &fds, NULL, NULL);
+		if (0 <= poll_fd) {
+			dolog(LOG_DEBUG, "Polling /dev/random");
+			FD_SET(poll_fd, &fds);
+		}
+		ret = pselect((poll_fd + 1), NULL, &fds, NULL, NULL,
+			      &waitmask);
 
 		if (-1 == ret && EINTR != errno)
 			dolog(LOG_ERR, "Select returned with error %s", strerror(errno));
-		if (0 <= ret) {
+		if (Alarm_pending) {
+			Alarm_pending = 0;
+			check_entropy_avail();
+		}
+		if (Stats_pending) {
+			Stats_pending = 0;
+			write_stats();
+		}
+		if (0 < ret) {
 			dolog(LOG_VERBOSE, "Wakeup call for select on /dev/random");
-			written = gather_entropy(&Random);
-			dolog(LOG_VERBOSE, "%lu bytes written to /dev/random", written);
+			written = trace_wakeup(RNGD_WAKEUP_POLL, -1, 1);
+			dolog(LOG_VERBOSE, "%lu bytes written to the sinks", written);
+			/* do not spin while the output is paused */
+			if (!written)
+				usleep(100000);
 		}
 	}
 }
@@ -309,7 +836,401 @@ static void install_alarm(void)
 {
 	dolog(LOG_DEBUG, "Install alarm signal handler");
 	signal(SIGALRM, sig_entropy_avail);
-	alarm(5);
+	alarm(Sched.interval);
+}
+
+/*******************************************************************
+ * Self test functions
+ *******************************************************************/
+
+static void read_clocksource(char *buf, size_t len)
+{
+	ssize_t data = 0;
+	int fd = open(CLOCKSOURCE, O_RDONLY);
+
+	buf[0] = '\0';
+	if (0 > fd)
+		return;
+	data = read(fd, buf, len - 1);
+	close(fd);
+	if (0 > data)
+		data = 0;
+	buf[data] = '\0';
+	if (data && '\n' == buf[data - 1])
+		buf[data - 1] = '\0';
+}
+
+/*
+ * Repeat the timer tests and estimate the min-entropy of the raw time
+ * deltas. The design of the entropy collector requires one bit of entropy
+ * per time delta and oversampling rate -- derive the oversampling rate
+ * needed to maintain that. The timer tests leave the result cached by
+ * jent_entropy_init alone.
+ *
+ * return: required oversampling rate, 0 if the timer is unusable
+ */
+static unsigned int selftest_run(struct rand_data *ec)
+{
+	__u64 *deltas = NULL;
+	double entropy = 0;
+	int ret = 0;
+	unsigned int osr = MAX_OSR;
+
+	ret = jent_entropy_check();
+	if (ret) {
+		dolog(LOG_WARN, "Self test: timer tests failed with error code %d", ret);
+		return 0;
+	}
+
+	deltas = malloc(SELFTEST_SAMPLES * sizeof(__u64));
+	if (!deltas) {
+		dolog(LOG_WARN, "Self test: cannot allocate memory");
+		return MAX_OSR;
+	}
+	if (0 > jent_read_raw(ec, deltas, SELFTEST_SAMPLES)) {
+		dolog(LOG_WARN, "Self test: health test on raw data failed");
+		goto out;
+	}
+	entropy = jent_est_mcv(deltas, SELFTEST_SAMPLES);
+	dolog(LOG_VERBOSE, "Self test: min-entropy %.3f bits per time delta",
+	      entropy);
+
+	if (1.0 <= entropy)
+		osr = 1;
+	else if ((1.0 / MAX_OSR) < entropy)
+		osr = (unsigned int)ceil(1.0 / entropy);
+	else
+		dolog(LOG_WARN, "Self test: min-entropy %.3f bits per time delta is insufficient",
+		      entropy);
+
+out:
+	memset(deltas, 0, SELFTEST_SAMPLES * sizeof(__u64));
+	free(deltas);
+	return osr;
+}
+
+/*
+ * Read the steal time and the total time from /proc/stat.
+ *
+ * return: 0 on success, -1 on error
+ */
+static int read_steal(unsigned long long *steal, unsigned long long *total)
+{
+	unsigned long long val[8];
+	char buf[256];
+	FILE *f = fopen(PROCSTAT, "r");
+	int i;
+
+	if (!f)
+		return -1;
+	if (!fgets(buf, sizeof(buf), f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	memset(val, 0, sizeof(val));
+	/* user nice system idle iowait irq softirq steal */
+	if (4 > sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+		       &val[0], &val[1], &val[2], &val[3], &val[4], &val[5],
+		       &val[6], &val[7]))
+		return -1;
+	*total = 0;
+	for (i = 0; i < 8; i++)
+		*total += val[i];
+	*steal = val[7];
+	return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	__u64 x = *(const __u64 *)a;
+	__u64 y = *(const __u64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Median of a small window of raw time deltas
+ *
+ * return: median or 0 on error
+ */
+static __u64 sample_median(struct rand_data *ec)
+{
+	__u64 deltas[SHIFT_SAMPLES];
+	__u64 median = 0;
+
+	if (0 > jent_read_raw(ec, deltas, SHIFT_SAMPLES))
+		return 0;
+	qsort(deltas, SHIFT_SAMPLES, sizeof(__u64), cmp_u64);
+	median = deltas[SHIFT_SAMPLES / 2];
+	memset(deltas, 0, sizeof(deltas));
+	return median;
+}
+
+/*
+ * Check for steal time rising above the threshold and for a shift of the
+ * time deltas compared to @baseline.
+ *
+ * return: 1 if a migration is suspected, 0 otherwise
+ */
+static int monitor_migration(struct rand_data *ec, __u64 baseline,
+			     unsigned long long *steal,
+			     unsigned long long *total, int *stealing)
+{
+	unsigned long long new_steal = 0, new_total = 0;
+	__u64 median = 0;
+	int ret = 0;
+
+	if (!read_steal(&new_steal, &new_total) && new_total > *total) {
+		unsigned long long pct = ((new_steal - *steal) * 100) /
+					 (new_total - *total);
+
+		/* only act on the rising edge to not repeat the self test
+		 * every second while the steal time stays high */
+		if (STEAL_THRESHOLD <= pct && !*stealing) {
+			dolog(LOG_WARN, "Monitor: steal time rose to %llu%%", pct);
+			ret = 1;
+		}
+		*stealing = (STEAL_THRESHOLD <= pct);
+		*steal = new_steal;
+		*total = new_total;
+	}
+
+	median = sample_median(ec);
+	if (baseline && median &&
+	    (median > baseline * SHIFT_FACTOR ||
+	     median * SHIFT_FACTOR < baseline)) {
+		dolog(LOG_WARN, "Monitor: median time delta shifted from %llu to %llu",
+		      (unsigned long long)baseline, (unsigned long long)median);
+		ret = 1;
+	}
+
+	return ret;
+}
+
+static void pause_output(int pause)
+{
+	pthread_mutex_lock(&Osr_lock);
+	Output_paused = pause;
+	pthread_mutex_unlock(&Osr_lock);
+}
+
+static void *selftest(void *arg)
+{
+	struct rand_data *ec = NULL;
+	struct sched_param param = { .sched_priority = 0 };
+	char clocksource[64];
+	char current[64];
+	time_t last = time(NULL);
+	sigset_t all;
+	unsigned long long steal = 0, total = 0;
+	int stealing = 0;
+	__u64 baseline = 0;
+	int failed = 0;
+
+	/* signals are handled by the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+	/* the self test shall only use otherwise idle CPU time */
+	if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param))
+		dolog(LOG_VERBOSE, "Self test: cannot use SCHED_IDLE");
+
+	ec = jent_entropy_collector_alloc(1, 0);
+	if (!ec) {
+		dolog(LOG_WARN, "Self test: allocation of entropy collector failed");
+		return NULL;
+	}
+	read_clocksource(clocksource, sizeof(clocksource));
+	dolog(LOG_VERBOSE, "Self test: clocksource %s, interval %u seconds",
+	      clocksource, Selftest_interval);
+	if (Monitor) {
+		read_steal(&steal, &total);
+		baseline = sample_median(ec);
+	}
+
+	while (1) {
+		unsigned int osr;
+		int run = 0;
+		int migrated = 0;
+
+		sleep(1);
+		read_clocksource(current, sizeof(current));
+		if (strcmp(current, clocksource)) {
+			dolog(LOG_WARN, "Self test: clocksource changed from %s to %s",
+			      clocksource, current);
+			strncpy(clocksource, current, sizeof(clocksource));
+			run = 1;
+		}
+		if (Monitor)
+			migrated = monitor_migration(ec, baseline, &steal,
+						     &total, &stealing);
+		if (Selftest_interval &&
+		    (time(NULL) - last) >= Selftest_interval)
+			run = 1;
+		/* output stays paused until the timer passes again */
+		if (failed)
+			run = 1;
+		if (!run && !migrated)
+			continue;
+
+		if (migrated)
+			pause_output(1);
+		osr = selftest_run(ec);
+		last = time(NULL);
+		if (Monitor)
+			baseline = sample_median(ec);
+
+		failed = !osr;
+		pthread_mutex_lock(&Osr_lock);
+		if (failed) {
+			if (!Output_paused)
+				dolog(LOG_WARN, "Self test: output paused until the timer tests pass");
+			Output_paused = 1;
+			pthread_mutex_unlock(&Osr_lock);
+			continue;
+		}
+		if (osr != Osr_required)
+			dolog(LOG_WARN, "Self test: required oversampling rate changes from %u to %u",
+			      Osr_required, osr);
+		Osr_required = osr;
+		Output_paused = 0;
+		pthread_mutex_unlock(&Osr_lock);
+	}
+
+	return NULL;
+}
+
+/*******************************************************************
+ * Correlation monitor functions
+ *******************************************************************/
+
+/*
+ * Hand a sample of the output of every entropy collector to the
+ * correlation monitor. If the monitor did not yet process the previous
+ * sample, this sample is skipped.
+ */
+static void corr_submit(struct kernel_rng *rng, char *buf, size_t share)
+{
+	unsigned int i, words = share / sizeof(__u64);
+
+	if (CORR_WORDS < words)
+		words = CORR_WORDS;
+	/* the monitor is not yet running during the initial fill */
+	if (!Corr_sample || !words || pthread_mutex_trylock(&Corr_lock))
+		return;
+	if (!Corr_words) {
+		for (i = 0; i < rng->nr_collectors; i++)
+			memcpy(&Corr_sample[i * CORR_WORDS], buf + i * share,
+			       words * sizeof(__u64));
+		Corr_words = words;
+		pthread_cond_signal(&Corr_cond);
+	}
+	pthread_mutex_unlock(&Corr_lock);
+}
+
+static void *corr_monitor(void *arg)
+{
+	unsigned int n = Random.nr_collectors;
+	unsigned long *agree = calloc(n * n, sizeof(unsigned long));
+	unsigned long *bits = calloc(n * n, sizeof(unsigned long));
+	unsigned long *collisions = calloc(n * n, sizeof(unsigned long));
+	__u64 *sample = calloc(n * CORR_WORDS, sizeof(__u64));
+	sigset_t all;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+	if (!agree || !bits || !collisions || !sample) {
+		dolog(LOG_WARN, "Correlation monitor: cannot allocate memory");
+		return NULL;
+	}
+
+	while (1) {
+		unsigned int i, j, k, words, correlated = 0;
+
+		pthread_mutex_lock(&Corr_lock);
+		while (!Corr_words)
+			pthread_cond_wait(&Corr_cond, &Corr_lock);
+		words = Corr_words;
+		memcpy(sample, Corr_sample, n * CORR_WORDS * sizeof(__u64));
+		memset(Corr_sample, 0, n * CORR_WORDS * sizeof(__u64));
+		Corr_words = 0;
+		pthread_mutex_unlock(&Corr_lock);
+
+		for (i = 0; i < n; i++) {
+			for (j = i + 1; j < n; j++) {
+				for (k = 0; k < words; k++) {
+					__u64 a = sample[i * CORR_WORDS + k];
+					__u64 b = sample[j * CORR_WORDS + k];
+
+					agree[i * n + j] +=
+						__builtin_popcountll(~(a ^ b));
+					bits[i * n + j] += 64;
+					if (a == b)
+						collisions[i * n + j]++;
+				}
+			}
+		}
+		memset(sample, 0, n * CORR_WORDS * sizeof(__u64));
+
+		/* all pairs see the same number of bits */
+		if (CORR_WINDOW > bits[1])
+			continue;
+
+		for (i = 0; i < n; i++) {
+			for (j = i + 1; j < n; j++) {
+				unsigned long idx = i * n + j;
+				double r = 2.0 * agree[idx] / bits[idx] - 1.0;
+
+				if (fabs(r) > CORR_SIGMA / sqrt(bits[idx]) ||
+				    collisions[idx]) {
+					dolog(LOG_WARN, "Correlation monitor: collectors %u and %u correlate with %.4f, %lu identical words",
+					      i, j, r, collisions[idx]);
+					correlated = 1;
+				}
+				dolog(LOG_DEBUG, "Correlation monitor: collectors %u and %u correlation %.4f",
+				      i, j, r);
+				agree[idx] = 0;
+				bits[idx] = 0;
+				collisions[idx] = 0;
+			}
+		}
+
+		pthread_mutex_lock(&Osr_lock);
+		if (correlated && 100 == Credit)
+			dolog(LOG_WARN, "Correlation monitor: crediting entropy of one collector only");
+		else if (!correlated && 100 != Credit)
+			dolog(LOG_WARN, "Correlation monitor: crediting full entropy again");
+		Credit = correlated ? (100 / n) : 100;
+		pthread_mutex_unlock(&Osr_lock);
+	}
+
+	return NULL;
+}
+
+static void install_corr_monitor(void)
+{
+	if (!Correlation)
+		return;
+	if (2 > Random.nr_collectors) {
+		dolog(LOG_WARN, "Correlation monitor requires more than one collector");
+		Correlation = 0;
+		return;
+	}
+	Corr_sample = calloc(Random.nr_collectors * CORR_WORDS, sizeof(__u64));
+	if (!Corr_sample)
+		dolog(LOG_ERR, "Cannot allocate memory for correlation monitor");
+	dolog(LOG_DEBUG, "Start correlation monitor thread");
+	if (pthread_create(&Corr_thread, NULL, corr_monitor, NULL))
+		dolog(LOG_ERR, "Cannot start correlation monitor thread");
+}
+
+static void install_selftest(void)
+{
+	if (!Selftest_interval && !Monitor)
+		return;
+	dolog(LOG_DEBUG, "Start self test thread");
+	if (pthread_create(&Selftest_thread, NULL, selftest, NULL))
+		dolog(LOG_ERR, "Cannot start self test thread");
 }
 
 static void install_term(void)
@@ -319,26 +1240,103 @@ static void install_term(void)
 	signal(SIGINT, sig_term);
 	signal(SIGQUIT, sig_term);
 	signal(SIGTERM, sig_term);
+	signal(SIGUSR1, sig_stats);
 }
 
 /*******************************************************************
  * allocation functions
  *******************************************************************/
 
+/*
+ * Place the collector threads on the CPUs: physical cores first, SMT
+ * siblings only when there are more collectors than physical cores. Any
+ * co-location is reported.
+ */
+static void place_collectors(struct kernel_rng *rng)
+{
+	struct jent_topology topo;
+	int *cpus = NULL;
+	unsigned int i, colocated = 0;
+
+	if (jent_topology_read(&topo)) {
+		dolog(LOG_WARN, "Cannot read CPU topology, collectors are not pinned");
+		return;
+	}
+	cpus = calloc(rng->nr_collectors, sizeof(int));
+	if (!cpus) {
+		jent_topology_free(&topo);
+		return;
+	}
+	jent_topology_spread(&topo, rng->nr_collectors, cpus);
+	for (i = 0; i < rng->nr_collectors; i++) {
+		rng->collectors[i].cpu = cpus[i];
+		dolog(LOG_VERBOSE, "Collector %u on CPU %d (physical core %d)",
+		      i, cpus[i], jent_topology_core_of(&topo, cpus[i]));
+	}
+	colocated = jent_topology_colocated(&topo, cpus, rng->nr_collectors);
+	if (colocated)
+		dolog(LOG_WARN, "%u of %u collectors share a physical core with another collector",
+		      colocated, rng->nr_collectors);
+	free(cpus);
+	jent_topology_free(&topo);
+}
+
+static void alloc_collectors(struct kernel_rng *rng)
+{
+	unsigned int i;
+
+	rng->nr_collectors = Nr_collectors;
+	rng->collectors = calloc(rng->nr_collectors, sizeof(struct collector));
+	if (!rng->collectors)
+		dolog(LOG_ERR, "Cannot allocate memory for collectors");
+
+	for (i = 0; i < rng->nr_collectors; i++) {
+		rng->collectors[i].cpu = -1;
+		rng->collectors[i].ec = jent_entropy_collector_alloc(rng->osr, 0);
+		if (!rng->collectors[i].ec)
+			dolog(LOG_ERR, "Allocation of entropy collector failed");
+	}
+	if (1 == rng->nr_collectors)
+		return;
+
+	place_collectors(rng);
+	for (i = 0; i < rng->nr_collectors; i++) {
+		struct collector *c = &rng->collectors[i];
+
+		if (pthread_create(&c->thread, NULL, collector_thread, c))
+			dolog(LOG_ERR, "Cannot start collector thread");
+		if (0 <= c->cpu) {
+			cpu_set_t set;
+
+			CPU_ZERO(&set);
+			CPU_SET(c->cpu, &set);
+			if (pthread_setaffinity_np(c->thread, sizeof(set), &set))
+				dolog(LOG_WARN, "Cannot pin collector %u to CPU %d",
+				      i, c->cpu);
+		}
+	}
+}
+
 static void alloc_rng(struct kernel_rng *rng)
 {
-	rng->ec = jent_entropy_collector_alloc(1, 0);
-	if (!rng->ec)
-		dolog(LOG_ERR, "Allocation of entropy collector failed");
+	rng->osr = Osr;
+	alloc_collectors(rng);
+}
+
+static void alloc_sinks(void)
+{
+	unsigned int i;
 
-	rng->rpi = malloc((sizeof(struct rand_pool_info) +
-			  (RNDBYTES * sizeof(char))));
-	if (!rng->rpi)
-		dolog(LOG_ERR, "Cannot allocate memory for random bytes");
+	if (!Nr_sinks)
+		rngd_sink_parse(&Sinks[Nr_sinks++], "kernel");
+	for (i = 0; i < Nr_sinks; i++) {
+		int ret = rngd_sink_open(&Sinks[i], Sched.batch);
 
-	rng->fd = open(rng->dev, O_WRONLY);
-	if (-1 == rng->fd)
-		dolog(LOG_ERR, "Open of %s failed: %s", rng->dev, strerror(errno));
+		if (ret)
+			dolog(LOG_ERR, "Open of sink %s failed: %s",
+			      Sinks[i].spec, strerror(-ret));
+		dolog(LOG_VERBOSE, "Feeding sink %s", Sinks[i].spec);
+	}
 }
 
 static void alloc(void)
@@ -346,44 +1344,58 @@ static void alloc(void)
 	int ret = 0;
 	size_t written = 0;
 
+	if (Fips140)
+		jent_fips140_init(&Fips140_state);
+
 	ret = jent_entropy_init();
 	if (ret)
 		dolog(LOG_ERR, "The initialization of CPU Jitter RNG failed with error code %d\n", ret);
 
 	alloc_rng(&Random);
+	alloc_sinks();
+
+	if (Tracefile) {
+		Trace = fopen(Tracefile, "w");
+		if (!Trace)
+			dolog(LOG_ERR, "Cannot open trace file %s: %s",
+			      Tracefile, strerror(errno));
+		fprintf(Trace, "# jitterentropy-rngd trace: threshold %u, batch %u, interval %u\n",
+			Sched.threshold, Sched.batch, Sched.interval);
+		Trace_start = clock_ns(CLOCK_MONOTONIC);
+	}
 
-	Entropy_avail_fd = open(ENTROPYAVAIL, O_RDONLY);
-	if (-1 == Entropy_avail_fd)
-		dolog(LOG_ERR, "Open of %s failed: %s", ENTROPYAVAIL, strerror(errno));
-
-	written = gather_entropy(&Random);
-	dolog(LOG_VERBOSE, "%lu bytes written to /dev/random", written);
+	written = trace_wakeup(RNGD_WAKEUP_START, -1, 1);
+	dolog(LOG_VERBOSE, "%lu bytes written to the sinks", written);
 }
 
 static void dealloc_rng(struct kernel_rng *rng)
 {
-	if (NULL != rng->ec) {
-		jent_entropy_collector_free(rng->ec);
-		rng->ec = NULL;
-	}
-	if (NULL != rng->rpi) {
-		memset(rng->rpi, 0,(sizeof(struct rand_pool_info) +
-				    (RNDBYTES * sizeof(char))));
-		free(rng->rpi);
-		rng->rpi = NULL;
-	}
-	if (0 != rng->fd) {
-		close(rng->fd);
-		rng->fd = 0;
+	unsigned int i;
+
+	/* collector threads still working on a request (termination signal
+	 * during gather_entropy) keep their entropy collector until the
+	 * process exits */
+	if (NULL != rng->collectors && !Work_pending) {
+		/* collector threads are idle and terminate with the process */
+		for (i = 0; i < rng->nr_collectors; i++)
+			if (NULL != rng->collectors[i].ec)
+				jent_entropy_collector_free(rng->collectors[i].ec);
+		free(rng->collectors);
+		rng->collectors = NULL;
+		rng->nr_collectors = 0;
 	}
 }
 
 static void dealloc(void)
 {
+	unsigned int i;
+
 	dealloc_rng(&Random);
-	if(0 != Entropy_avail_fd) {
-		close(Entropy_avail_fd);
-		Entropy_avail_fd = 0;
+	for (i = 0; i < Nr_sinks; i++)
+		rngd_sink_close(&Sinks[i]);
+	if (Trace) {
+		fclose(Trace);
+		Trace = NULL;
 	}
 
 	if (0 != Pidfile_fd) {
@@ -467,15 +1479,23 @@ static void daemonize(void)
 
 int main(int argc, char *argv[])
 {
-	if (geteuid())
-		dolog(LOG_ERR, "Program must start as root!");
+	unsigned int i;
 
 	parse_opts(argc, argv);
+	/* only the kernel sink requires root, it is the default */
+	for (i = 0; i < Nr_sinks; i++)
+		if (RNGD_SINK_KERNEL == Sinks[i].type)
+			break;
+	if ((!Nr_sinks || i < Nr_sinks) && geteuid())
+		dolog(LOG_ERR, "Program must start as root!");
+
 	if (0 == Verbosity)
 		daemonize();
 	alloc();
 	install_term();
 	install_alarm();
+	install_selftest();
+	install_corr_monitor();
 	select_fd();
 	/* NOTREACHED */
 	dealloc();
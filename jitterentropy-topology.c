@@ -0,0 +1,200 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * CPU topology helpers for placing entropy collectors
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, and the entire permission notice in its entirety,
+ *    including the disclaimer of warranties.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * ALTERNATIVELY, this product may be distributed under the terms of
+ * the GNU General Public License, in which case the provisions of the GPL are
+ * required INSTEAD OF the above restrictions.  (This clause is
+ * necessary due to a potential bad interaction between the GPL and
+ * the restrictions contained in a BSD-style copyright.)
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Entropy collectors running on two SMT siblings of one physical core
+ * compete for the same execution units and L1 caches. This lowers the
+ * throughput of both and may correlate their timing jitter. The helpers
+ * below read the SMT sibling information from sysfs and place entropy
+ * collectors on distinct physical cores first before SMT siblings are
+ * used.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+
+#include "jitterentropy-topology.h"
+
+#define SIBLINGS "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list"
+
+/*
+ * Obtain the lowest CPU of a CPU list such as "0,4" or "0-1" -- this is
+ * used as identifier of the physical core.
+ */
+static int jent_topology_core(int cpu)
+{
+	char path[128];
+	FILE *f;
+	int first = -1;
+
+	snprintf(path, sizeof(path), SIBLINGS, cpu);
+	f = fopen(path, "r");
+	if (!f)
+		return cpu;
+	if (1 != fscanf(f, "%d", &first))
+		first = cpu;
+	fclose(f);
+
+	return first;
+}
+
+/*
+ * Read the topology of the CPUs the process may run on.
+ *
+ * return: 0 on success, < 0 on error
+ */
+int jent_topology_read(struct jent_topology *topo)
+{
+	cpu_set_t set;
+	unsigned int i, n = 0;
+
+	memset(topo, 0, sizeof(*topo));
+	if (sched_getaffinity(0, sizeof(set), &set))
+		return -errno;
+
+	topo->cpu = calloc(CPU_COUNT(&set), sizeof(int));
+	topo->core = calloc(CPU_COUNT(&set), sizeof(int));
+	if (!topo->cpu || !topo->core) {
+		jent_topology_free(topo);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < CPU_SETSIZE && n < (unsigned int)CPU_COUNT(&set); i++) {
+		if (!CPU_ISSET(i, &set))
+			continue;
+		topo->cpu[n] = i;
+		topo->core[n] = jent_topology_core(i);
+		n++;
+	}
+	topo->nr_cpus = n;
+
+	return 0;
+}
+
+void jent_topology_free(struct jent_topology *topo)
+{
+	free(topo->cpu);
+	free(topo->core);
+	memset(topo, 0, sizeof(*topo));
+}
+
+/*
+ * Select the CPUs for @n entropy collectors: first one CPU of every
+ * physical core, then the second SMT sibling of every core and so on. If
+ * more entropy collectors than CPUs are requested, the order repeats.
+ *
+ * @cpus: array of @n entries receiving the CPUs
+ */
+void jent_topology_spread(const struct jent_topology *topo, unsigned int n,
+			  int *cpus)
+{
+	unsigned int *rank;
+	unsigned int i, j, k = 0, round;
+
+	if (!topo->nr_cpus) {
+		for (i = 0; i < n; i++)
+			cpus[i] = -1;
+		return;
+	}
+
+	/* rank of every CPU among the SMT siblings of its core */
+	rank = calloc(topo->nr_cpus, sizeof(unsigned int));
+	if (!rank) {
+		for (i = 0; i < n; i++)
+			cpus[i] = topo->cpu[i % topo->nr_cpus];
+		return;
+	}
+	for (i = 0; i < topo->nr_cpus; i++)
+		for (j = 0; j < i; j++)
+			if (topo->core[j] == topo->core[i])
+				rank[i]++;
+
+	for (round = 0; k < n; round++) {
+		unsigned int found = 0;
+
+		for (i = 0; i < topo->nr_cpus && k < n; i++) {
+			if (rank[i] != round)
+				continue;
+			cpus[k++] = topo->cpu[i];
+			found = 1;
+		}
+		/* all SMT siblings used -- start over */
+		if (!found)
+			round = (unsigned int)-1;
+	}
+	free(rank);
+}
+
+/*
+ * Physical core of a CPU as known from the topology.
+ *
+ * return: core identifier, -1 if the CPU is unknown
+ */
+int jent_topology_core_of(const struct jent_topology *topo, int cpu)
+{
+	unsigned int i;
+
+	for (i = 0; i < topo->nr_cpus; i++)
+		if (topo->cpu[i] == cpu)
+			return topo->core[i];
+	return -1;
+}
+
+/*
+ * Count the entropy collectors which share a physical core with another
+ * entropy collector, either on an SMT sibling or on the same CPU.
+ */
+unsigned int jent_topology_colocated(const struct jent_topology *topo,
+				     const int *cpus, unsigned int n)
+{
+	unsigned int i, j, colocated = 0;
+
+	for (i = 0; i < n; i++) {
+		int core = jent_topology_core_of(topo, cpus[i]);
+
+		for (j = 0; j < n; j++) {
+			if (i != j &&
+			    core == jent_topology_core_of(topo, cpus[j])) {
+				colocated++;
+				break;
+			}
+		}
+	}
+	return colocated;
+}
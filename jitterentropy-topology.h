@@ -0,0 +1,32 @@
+/*
+ * Non-physical true random number generator based on timing jitter.
+ *
+ * CPU topology helpers for placing entropy collectors
+ *
+ * See jitterentropy-topology.c for the license.
+ */
+
+#ifndef _JITTERENTROPY_TOPOLOGY_H
+#define _JITTERENTROPY_TOPOLOGY_H
+
+#include "jitterentropy.h"
+
+/* CPUs usable by the process and their physical cores */
+struct jent_topology {
+	unsigned int nr_cpus;	/* Number of usable CPUs */
+	int *cpu;		/* CPU numbers */
+	int *core;		/* Physical core of the CPU, i.e. its lowest
+				 * SMT sibling */
+};
+
+int jent_topology_read(struct jent_topology *topo);
+void jent_topology_free(struct jent_topology *topo);
+/* spread entropy collectors across physical cores first */
+void jent_topology_spread(const struct jent_topology *topo, unsigned int n,
+			  int *cpus);
+int jent_topology_core_of(const struct jent_topology *topo, int cpu);
+/* number of entropy collectors sharing a physical core */
+unsigned int jent_topology_colocated(const struct jent_topology *topo,
+				     const int *cpus, unsigned int n);
+
+#endif /* _JITTERENTROPY_TOPOLOGY_H */
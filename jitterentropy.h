@@ -89,9 +89,24 @@ struct rand_data
 #define DATA_SIZE_BITS ((sizeof(__u64)) * 8)
 	__u64 old_data;		/* SENSITIVE FIPS continuous test */
 	unsigned int osr;	/* Oversample rate */
+	unsigned int flags;	/* Flags used for allocation */
 	unsigned int fips_fail:1;	/* FIPS status */
 	unsigned int stir:1;		/* Post-processing stirring */
 	unsigned int disable_unbias:1;	/* Deactivate Von-Neuman unbias */
+	unsigned int single_timestamp:1; /* Loop shuffle reuses ->prev_time */
+	unsigned int fixed_cost:1;	/* Fixed fold loops, bounded unbias */
+	unsigned int unbias_budget;	/* Von-Neuman rejections allowed per
+					 * 64 bit word, 0 means unlimited */
+	unsigned int unbias_rejects;	/* Rejections in the current word */
+	__u64 unbias_fallbacks;		/* Number of bits taken without
+					 * unbias as the budget was used up */
+	__u64 unbias_pairs;		/* Von-Neuman pairs evaluated */
+	__u64 unbias_discarded;		/* Von-Neuman pairs rejected */
+	__u64 latency_bound;		/* Calibrated worst case time for
+					 * one 64 bit word */
+	__u64 raw_last_delta;		/* SENSITIVE Last delta returned by
+					 * jent_read_raw */
+	unsigned int raw_rep;		/* Repetitions of ->raw_last_delta */
 #define JENT_MEMORY_BLOCKS 64
 #define JENT_MEMORY_BLOCKSIZE 32
 #define JENT_MEMORY_ACCESSLOOPS 128
@@ -103,17 +118,67 @@ struct rand_data
 	unsigned int memblocksize; /* Size of one memory block in bytes */
 	unsigned int memaccessloops; /* Number of memory accesses per random
 				      * bit generation */
+#ifdef JENT_INSTRUMENT
+	unsigned int instrument;	/* JENT_INSTR_* features enabled */
+	__u64 instr_samples;		/* Time deltas measured */
+	__u64 instr_delta_sum;		/* Sum of the time deltas */
+	__u64 instr_words;		/* 64 bit words generated */
+#define JENT_INSTR_HIST_BUCKETS 64
+	__u64 instr_hist[JENT_INSTR_HIST_BUCKETS]; /* Time deltas by the
+						    * position of their
+						    * highest set bit */
+	void (*instr_trace)(void *priv, __u64 delta); /* Called with every
+						       * time delta */
+	void *instr_priv;		/* Argument of ->instr_trace */
+#endif
+	struct jent_afalg *afalg;	/* Kernel RNG serving the reads
+					 * (JENT_AFALG_FALLBACK), NULL if
+					 * the collection runs here */
 #ifdef CONFIG_CRYPTO_CPU_JITTERENTROPY_STAT
 	struct entropy_stat entropy_stat;
 #endif
 };
 
+/* Results of the timer tests performed by jent_entropy_init */
+struct jent_init_diag {
+	int ret;			/* Result returned by jent_entropy_init */
+	int shuffle_ret;		/* ESHUFFLE if JENT_SINGLE_TIMESTAMP
+					   collectors are refused */
+	int sequential;			/* Sequential test was performed */
+	unsigned int loops;		/* Number of evaluated test loops */
+	unsigned int time_backwards;	/* Time stamps running backwards */
+	unsigned int count_var;		/* Deltas differing from the previous */
+	unsigned int count_mod;		/* Deltas being a multiple of 100 */
+	unsigned int count_shuffle;	/* Variations of the loop shuffle */
+	__u64 delta_sum;		/* Sum of the delta of deltas */
+	__u64 min_delta;		/* Smallest observed time delta */
+	__u64 max_delta;		/* Largest observed time delta */
+};
+
 /* Flags that can be used to initialize the RNG */
 #define JENT_DISABLE_STIR (1<<0) /* Disable stirring the entropy pool */
 #define JENT_DISABLE_UNBIAS (1<<1) /* Disable Von Neuman unbias */
 #define JENT_DISABLE_MEMORY_ACCESS (1<<2) /* Disable memory access for more
 					     entropy, saves MEMORY_SIZE RAM for
 					     entropy collector */
+#define JENT_SINGLE_TIMESTAMP (1<<3) /* Derive the loop shuffle from the time
+					stamp taken by jent_measure_jitter
+					instead of reading the timer again,
+					halves the timer reads per sample --
+					the allocation fails if the time
+					stamps alone do not vary the loop
+					shuffle (see ESHUFFLE) */
+#define JENT_FIXED_COST (1<<4) /* Bounded worst case latency: fixed fold
+				  loop count and a capped Von-Neuman
+				  rejection budget per 64 bit word */
+#define JENT_MEMORY_SHIFT(x) (((x) & 0xf) << 8) /* Memory access noise
+						   source uses
+						   JENT_MEMORY_SIZE << x
+						   bytes, up to 64MB */
+#define JENT_MEMORY_SHIFT_MASK JENT_MEMORY_SHIFT(0xf)
+#define JENT_AFALG_FALLBACK (1<<5) /* Serve reads from the kernel's
+				      jitterentropy_rng via AF_ALG if
+				      jent_entropy_init failed */
 
 /* Number of low bits of the time value that we want to consider */
 #define TIME_ENTROPY_BITS 1
@@ -126,17 +191,94 @@ struct rand_data
 /* get raw entropy */
 int jent_read_entropy(struct rand_data *entropy_collector,
 		      char *data, size_t len);
+/* get raw time deltas -- must be conditioned by the caller */
+int jent_read_raw(struct rand_data *entropy_collector, __u64 *deltas,
+		  size_t n);
 /* initialize an instance of the entropy collector */
 struct rand_data *jent_entropy_collector_alloc(unsigned int osr,
 	       				       unsigned int flags);
 /* clearing of entropy collector */
 void jent_entropy_collector_free(struct rand_data *entropy_collector);
+/* calibrate the worst case latency of one 64 bit word */
+__u64 jent_latency_calibrate(struct rand_data *entropy_collector,
+			     unsigned int rounds);
+/* bits taken without unbias as the JENT_FIXED_COST budget was used up */
+__u64 jent_unbias_fallbacks(struct rand_data *entropy_collector);
+#ifdef JENT_INSTRUMENT
+/* Instrumented builds only: runtime instrumentation of the entropy
+ * collection -- the probes run inside the measured time deltas */
+#define JENT_INSTR_COUNTERS (1<<0) /* ->instr_samples, _delta_sum, _words */
+#define JENT_INSTR_HISTOGRAM (1<<1) /* ->instr_hist */
+#define JENT_INSTR_TRACE (1<<2) /* ->instr_trace callback */
+int jent_instrument(struct rand_data *entropy_collector, unsigned int features,
+		    void (*trace)(void *priv, __u64 delta), void *priv);
+#endif
+#ifdef JENT_BENCH_STAGES
+/* Benchmark builds only: run one stage of the entropy collection -- not
+ * part of the library interface for regular callers */
+#define JENT_STAGE_MEMACCESS	0
+#define JENT_STAGE_TIMER	1
+#define JENT_STAGE_SHUFFLE	2
+#define JENT_STAGE_FOLD		3
+#define JENT_STAGE_MEASURE	4
+#define JENT_STAGE_UNBIAS	5
+#define JENT_STAGE_STIR		6
+#define JENT_STAGE_GEN		7
+#define JENT_STAGE_MAX		8
+int jent_stage_run(struct rand_data *entropy_collector, unsigned int stage,
+		   unsigned int rounds);
+#endif
 
-/* initialization of entropy collector */
+/* initialization of entropy collector -- tests are performed once */
 int jent_entropy_init(void);
+/* initialization with sequential tests stopping early on good timers */
+int jent_entropy_init_seq(void);
+/* repeat the tests of the initialization */
+int jent_entropy_revalidate(void);
+/* repeat the tests without changing the cached result */
+int jent_entropy_check(void);
+/* diagnostic data of the last initialization tests */
+void jent_entropy_init_diag(struct jent_init_diag *diag);
+
+#ifndef __KERNEL__
+/* per-CPU entropy collectors for heavily threaded applications */
+struct jent_percpu;
+struct jent_percpu *jent_percpu_alloc(unsigned int osr, unsigned int flags);
+int jent_percpu_read_entropy(struct jent_percpu *pc, char *data, size_t len);
+void jent_percpu_free(struct jent_percpu *pc);
+
+/* the kernel's jitterentropy_rng via AF_ALG */
+struct jent_afalg;
+struct jent_afalg *jent_afalg_open(void);
+int jent_afalg_read(struct jent_afalg *afalg, char *data, size_t len);
+void jent_afalg_close(struct jent_afalg *afalg);
+
+/* process-wide cache of pre-warmed entropy collectors */
+int jent_collector_cache_start(unsigned int osr, unsigned int flags,
+			       unsigned int depth);
+void jent_collector_cache_stop(void);
+#endif /* __KERNEL__ */
 
 /* -- END of Main interface functions -- */
 
+/* -- BEGIN entropy collector life cycle functions used by the cache -- */
+
+struct rand_data *_jent_entropy_collector_alloc(unsigned int osr,
+						unsigned int flags);
+void _jent_entropy_collector_prime(struct rand_data *entropy_collector);
+void _jent_entropy_collector_wipe(struct rand_data *entropy_collector);
+void _jent_entropy_collector_free(struct rand_data *entropy_collector);
+#ifndef __KERNEL__
+struct rand_data *jent_afalg_collector_alloc(unsigned int osr,
+					     unsigned int flags);
+void jent_afalg_collector_free(struct rand_data *entropy_collector);
+struct rand_data *jent_collector_cache_get(unsigned int osr,
+					   unsigned int flags);
+int jent_collector_cache_put(struct rand_data *entropy_collector);
+#endif /* __KERNEL__ */
+
+/* -- END of entropy collector life cycle functions -- */
+
 /* -- BEGIN error codes for init function -- */
 #define ENOTIME  	1 /* Timer service not available */
 #define ECOARSETIME	2 /* Timer too coarse for RNG */
@@ -146,6 +288,10 @@ int jent_entropy_init(void);
 			     (2nd derivation of time is zero) */
 #define EMINVARVAR	6 /* Timer variations of variations is too small */
 #define EPROGERR	7 /* Programming error */
+#define ESHUFFLE	8 /* Time stamps do not vary the loop shuffle -- not
+			     returned by jent_entropy_init, but reported in
+			     jent_init_diag.shuffle_ret and refuses the
+			     allocation with JENT_SINGLE_TIMESTAMP */
 
 /* -- BEGIN statistical test functions only complied with CONFIG_CRYPTO_CPU_JITTERENTROPY_STAT -- */
 